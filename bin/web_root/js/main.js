@@ -58,6 +58,133 @@ function updateBgSettings() {
 
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
+// the server pushes each stream the page subscribes to down one WebSocket, a message
+// per frame: the stream's name, a newline, then image bytes or JSON text
+const socketImages = {
+  cameraImage: '#cameraImage'
+};
+const socketMasks = {
+  ballMask: '#ballMaskImage',
+  bgMask: '#bgMaskImage'
+};
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+function showBallState(state) {
+  let text = state.found ? `x ${state.x.toFixed(1)}, y ${state.y.toFixed(1)}, area ${state.area}` : 'no ball';
+  $('#ballState').text(text);
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+function showImage(selector, bytes, type) {
+  let image = $(selector);
+  let url = URL.createObjectURL(new Blob([ bytes ], { type: type }));
+  let previous = image.attr('src');
+  image.attr('src', url);
+  if (previous && previous.startsWith('blob:')) {
+    URL.revokeObjectURL(previous);
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+function readVarint(bytes, state) {
+  // unsigned LEB128, kept in a double so large masks don't overflow 32 bits
+  let value = 0;
+  let scale = 1;
+  let byte;
+  do {
+    byte = bytes[state.position++];
+    value += (byte & 0x7f) * scale;
+    scale *= 128;
+  } while (byte & 0x80);
+  return value;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// draws a mask sent as runs; see runMask::serialize() for the format
+function drawRuns(canvas, bytes) {
+  let state = { position: 0 };
+  let width = readVarint(bytes, state);
+  let height = readVarint(bytes, state);
+  let count = readVarint(bytes, state);
+  canvas.width = width;
+  canvas.height = height;
+  let context = canvas.getContext('2d');
+  let image = context.createImageData(width, height);
+  // one RGBA pixel per word: opaque black, or white inside a run (little-endian, as
+  // on every platform browsers run on)
+  let pixels = new Uint32Array(image.data.buffer);
+  pixels.fill(0xff000000);
+  let end = 0;
+  for (let i = 0; i < count; i++) {
+    let start = end + readVarint(bytes, state);
+    end = start + readVarint(bytes, state);
+    pixels.fill(0xffffffff, start, end);
+  }
+  context.putImageData(image, 0, 0);
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// masks come as PNG, JPEG or runs, as the server's maskFormat setting says; the first
+// two are told apart by their signatures, and the browser decodes them
+function drawMask(canvas, bytes) {
+  const pngSignature = [ 0x89, 0x50, 0x4e, 0x47, 0x0d, 0x0a, 0x1a, 0x0a ];
+  let png = pngSignature.every((value, i) => bytes[i] === value);
+  let jpeg = bytes[0] === 0xff && bytes[1] === 0xd8 && bytes[2] === 0xff;
+  if (!png && !jpeg) {
+    drawRuns(canvas, bytes);
+    return;
+  }
+  createImageBitmap(new Blob([ bytes ], { type: png ? 'image/png' : 'image/jpeg' })).then(function(bitmap) {
+    canvas.width = bitmap.width;
+    canvas.height = bitmap.height;
+    canvas.getContext('2d').drawImage(bitmap, 0, 0);
+  });
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+function connectSocket() {
+  let socket = new WebSocket(`ws://${window.location.host}/ws`);
+  socket.binaryType = 'arraybuffer';
+  socket.onopen = function() {
+    for (let name of Object.keys(socketImages).concat(Object.keys(socketMasks))) {
+      socket.send(`subscribe ${name}`);
+    }
+    socket.send('subscribe ballState');
+  };
+  socket.onmessage = function(event) {
+    if (typeof event.data === 'string') {
+      let newline = event.data.indexOf('\n');
+      let name = event.data.substring(0, newline);
+      if (name === 'ballState') {
+        showBallState(JSON.parse(event.data.substring(newline + 1)));
+      }
+      return;
+    }
+    let bytes = new Uint8Array(event.data);
+    let newline = bytes.indexOf(10);
+    let name = String.fromCharCode.apply(null, bytes.subarray(0, newline));
+    let payload = bytes.subarray(newline + 1);
+    if (name in socketMasks) {
+      drawMask($(socketMasks[name])[0], payload);
+    }
+    else if (name in socketImages) {
+      showImage(socketImages[name], payload, 'image/jpeg');
+    }
+  };
+  // if the socket drops, reconnect after a second
+  socket.onclose = function() {
+    window.setTimeout(connectSocket, 1000);
+  };
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
 $(document).ready(function() {
   $.get('/get/ballSettings', function(data, status) {
     if (status === 'success') {
@@ -104,17 +231,7 @@ $(document).ready(function() {
   $('#bgDilations').siblings('button').on('click',updateBgSettings);  
   
 
-  window.setInterval( function() {
-    $.get('/get/cameraImage',function(data, status) {
-      $('#cameraImage').attr('src',`data:image/jpeg;base64,${data}`);
-    });
-    $.get('/get/ballMask',function(data, status) {
-      $('#ballMaskImage').attr('src',`data:image/jpeg;base64,${data}`);
-    });
-    $.get('/get/bgMask',function(data, status) {
-      $('#bgMaskImage').attr('src',`data:image/jpeg;base64,${data}`);
-    });
-  }, 100);
+  connectSocket();
 });
 
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
@@ -0,0 +1,147 @@
+#include <cstdlib>
+#include <new>
+
+#include <opencv2/core.hpp>
+
+#include "allocationCounter.hpp"
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#ifdef SMM_COUNT_ALLOCATIONS
+
+// per thread, so other threads' allocations never show up in a frame's count
+static thread_local unsigned long allocations = 0;
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void* operator new(std::size_t size) {
+  allocations++;
+  void* p = std::malloc(size ? size : 1);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void* operator new[](std::size_t size) {
+  return operator new(size);
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+  allocations++;
+  return std::malloc(size ? size : 1);
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept {
+  return operator new(size, tag);
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void operator delete[](void* p) noexcept {
+  std::free(p);
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void operator delete(void* p, const std::nothrow_t&) noexcept {
+  std::free(p);
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+  std::free(p);
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#if CV_VERSION_MAJOR >= 4
+typedef cv::AccessFlag matAccessFlags;
+#else
+typedef int matAccessFlags;
+#endif
+
+// cv::Mat buffers come from cv::fastMalloc() rather than operator new, so they are
+// counted here; OpenCV's own allocator does the work
+class countingMatAllocator : public cv::MatAllocator {
+public:
+  cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+                         matAccessFlags flags, cv::UMatUsageFlags usageFlags) const {
+    // a Mat over caller-owned data allocates no buffer
+    if (data == NULL) {
+      allocations++;
+    }
+    return cv::Mat::getStdAllocator()->allocate(dims, sizes, type, data, step, flags, usageFlags);
+  }
+
+  bool allocate(cv::UMatData* data, matAccessFlags flags, cv::UMatUsageFlags usageFlags) const {
+    return cv::Mat::getStdAllocator()->allocate(data, flags, usageFlags);
+  }
+
+  void deallocate(cv::UMatData* data) const {
+    cv::Mat::getStdAllocator()->deallocate(data);
+  }
+};
+
+// installed before main(); the standard allocator frees the buffers, so Mats made
+// before this ran are unaffected
+static bool installMatAllocator() {
+  static countingMatAllocator allocator;
+  cv::Mat::setDefaultAllocator(&allocator);
+  return true;
+}
+
+static bool matAllocatorInstalled = installMatAllocator();
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+bool allocationCounting() {
+  return true;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+unsigned long threadAllocations() {
+  return allocations;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void chargeAllocations(unsigned long count) {
+  allocations += count;
+}
+
+#else
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+bool allocationCounting() {
+  return false;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+unsigned long threadAllocations() {
+  return 0;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void chargeAllocations(unsigned long) {}
+
+#endif
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
@@ -0,0 +1,36 @@
+/*! @file
+ * Declares the heap allocation counter used to check that the pipeline's steady
+ * state doesn't allocate.
+ *
+ * Counting is compiled in with @c SMM_COUNT_ALLOCATIONS (the CMake option of the same
+ * name), which replaces the global operator new and installs a counting default
+ * cv::MatAllocator, so new Mat buffers count too. Plain malloc() is not counted; no
+ * pipeline stage calls it, only the web server's C code does. OpenCV's
+ * internal scratch buffers (cv::AutoBuffer) are not counted either. Without the
+ * option the functions below are cheap no-ops and threadAllocations() always
+ * returns 0.
+ */
+
+#ifndef SMM_ALLOCATION_COUNTER_HPP
+#define SMM_ALLOCATION_COUNTER_HPP
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+/*! @brief Returns @c True if this build counts heap allocations. */
+bool allocationCounting();
+
+/*! @brief Returns the number of heap allocations the calling thread has made so far. */
+unsigned long threadAllocations();
+
+/*! @brief Count allocations made on another thread on behalf of the calling thread.
+ *
+ * threadPool uses this so that work it spreads over its workers is counted against
+ * the thread that called threadPool::run().
+ *
+ * @param count Number of allocations to add.
+ */
+void chargeAllocations(unsigned long count);
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#endif
@@ -0,0 +1,186 @@
+#include <cmath>
+#include <algorithm>
+
+#include <opencv2/imgproc.hpp>
+
+#include "ballDetector.hpp"
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// the ball is the largest blob; total is the area of all blobs together
+static struct ballState ballFromBlob(const struct maskBlob& blob, double total, double scaling,
+                                     const struct detectionSettings& s) {
+  struct ballState ball;
+
+  // each mask pixel covers 1/scaling^2 full-resolution pixels
+  double area = (double) blob.area;
+  ball.area = area / (scaling * scaling);
+  if (ball.area < s.minArea) {
+    return ball;
+  }
+
+  // pixel centers map back as (x + 0.5) / scaling - 0.5
+  ball.found = true;
+  ball.center.x = (float) ((blob.centroid.x + 0.5) / scaling - 0.5);
+  ball.center.y = (float) ((blob.centroid.y + 0.5) / scaling - 0.5);
+
+  int width = blob.bbox.width, height = blob.bbox.height;
+  ball.bbox = cv::Rect2f((float) (blob.bbox.x / scaling), (float) (blob.bbox.y / scaling),
+                         (float) (width / scaling), (float) (height / scaling));
+
+  // a disc fills pi/4 of its bounding box; stray blobs elsewhere lower the share
+  double fill = std::min(1.0, area / (CV_PI / 4 * width * height));
+  ball.confidence = (float) (fill * area / total);
+
+  double orientation, major, minor;
+  blob.moments.ellipse(orientation, major, minor);
+  ball.orientation = (float) orientation;
+  ball.axes = cv::Size2f((float) (major / scaling), (float) (minor / scaling));
+
+  return ball;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+struct ballState detectBall(const cv::Mat& ballMask, const cv::Mat& bgMask, double scaling,
+                            const struct detectionSettings& s) {
+  cv::Mat mask = ballMask;
+  if (!bgMask.empty()) {
+    // masks are 0/255, so a saturating subtract is AND-NOT
+    cv::subtract(ballMask, bgMask, mask);
+  }
+
+  cv::Mat labels, stats, centroids;
+  int count = cv::connectedComponentsWithStats(mask, labels, stats, centroids, 8, CV_32S);
+
+  // label 0 is the unmasked area
+  int best = 0;
+  double total = 0;
+  for (int i = 1; i < count; i++) {
+    int area = stats.at<int>(i, cv::CC_STAT_AREA);
+    total += area;
+    if (best == 0 || area > stats.at<int>(best, cv::CC_STAT_AREA)) {
+      best = i;
+    }
+  }
+  if (best == 0) {
+    return ballState();
+  }
+
+  struct maskBlob blob;
+  blob.area = stats.at<int>(best, cv::CC_STAT_AREA);
+  blob.centroid = cv::Point2d(centroids.at<double>(best, 0), centroids.at<double>(best, 1));
+  blob.bbox = cv::Rect(stats.at<int>(best, cv::CC_STAT_LEFT), stats.at<int>(best, cv::CC_STAT_TOP),
+                       stats.at<int>(best, cv::CC_STAT_WIDTH), stats.at<int>(best, cv::CC_STAT_HEIGHT));
+  cv::Moments m = cv::moments(labels == best, true);
+  blob.moments.m00 = m.m00;
+  blob.moments.m10 = m.m10;
+  blob.moments.m01 = m.m01;
+  blob.moments.m20 = m.m20;
+  blob.moments.m11 = m.m11;
+  blob.moments.m02 = m.m02;
+  return ballFromBlob(blob, total, scaling, s);
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+struct ballState detectBall(const struct maskMoments& moments, double scaling,
+                            const struct detectionSettings& s) {
+  struct ballState ball;
+  ball.area = moments.m00 / (scaling * scaling);
+  if (moments.m00 <= 0 || ball.area < s.minArea) {
+    return ball;
+  }
+
+  ball.found = true;
+  cv::Point2d c = moments.centroid();
+  ball.center.x = (float) ((c.x + 0.5) / scaling - 0.5);
+  ball.center.y = (float) ((c.y + 0.5) / scaling - 0.5);
+
+  double orientation, major, minor;
+  moments.ellipse(orientation, major, minor);
+  ball.orientation = (float) orientation;
+  ball.axes = cv::Size2f((float) (major / scaling), (float) (minor / scaling));
+
+  // the ellipse's extent along x and y, around the pixel centers
+  double a = major / 2, b = minor / 2;
+  double cosA = std::cos(orientation), sinA = std::sin(orientation);
+  double halfWidth = std::sqrt(a*a * cosA*cosA + b*b * sinA*sinA);
+  double halfHeight = std::sqrt(a*a * sinA*sinA + b*b * cosA*cosA);
+  ball.bbox = cv::Rect2f((float) ((c.x + 0.5 - halfWidth) / scaling), (float) ((c.y + 0.5 - halfHeight) / scaling),
+                         (float) (2 * halfWidth / scaling), (float) (2 * halfHeight / scaling));
+
+  // a single filled ellipse fills the ellipse fitted to it; pixels scattered
+  // elsewhere stretch the fit far more than they add area
+  double ellipseArea = CV_PI / 4 * major * minor;
+  ball.confidence = ellipseArea > 0 ? (float) std::min(1.0, moments.m00 / ellipseArea) : 0;
+
+  return ball;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+struct ballState detectBall(const bitMask& ballMask, const bitMask* bgMask, cv::Rect window,
+                            double scaling, const struct detectionSettings& s) {
+  ballDetector detector;
+  return detector.detect(ballMask, bgMask, window, scaling, s);
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+struct ballState ballDetector::detect(const bitMask& ballMask, const bitMask* bgMask, cv::Rect window,
+                                      double scaling, const struct detectionSettings& s,
+                                      size_t count, std::vector<struct ballState>* candidates) {
+  // the background is removed word by word while the window is turned into runs
+  runs.assign(ballMask, window, bgMask);
+  runs.blobs(blobs);
+  if (candidates) {
+    candidates->clear();
+  }
+
+  size_t best = 0;
+  double total = 0;
+  for (size_t i = 0; i < blobs.size(); i++) {
+    total += blobs[i].area;
+    if (blobs[i].area > blobs[best].area) {
+      best = i;
+    }
+  }
+  if (blobs.empty()) {
+    return ballState();
+  }
+
+  cv::Point2f offset((float) (window.x / scaling), (float) (window.y / scaling));
+  struct ballState ball = ballFromBlob(blobs[best], total, scaling, s);
+  if (ball.found) {
+    ball.center += offset;
+    ball.bbox.x += offset.x;
+    ball.bbox.y += offset.y;
+  }
+  if (!candidates || !ball.found) {
+    return ball;
+  }
+
+  // the largest blobs by area, ties in label order so the first is the ball above
+  order.clear();
+  for (size_t i = 0; i < blobs.size(); i++) {
+    order.push_back(i);
+  }
+  size_t listed = std::min(count, order.size());
+  std::partial_sort(order.begin(), order.begin() + listed, order.end(), [this](size_t a, size_t b) {
+    return blobs[a].area > blobs[b].area || (blobs[a].area == blobs[b].area && a < b);
+  });
+  for (size_t i = 0; i < listed; i++) {
+    struct ballState candidate = ballFromBlob(blobs[order[i]], total, scaling, s);
+    if (!candidate.found) {
+      break;
+    }
+    candidate.center += offset;
+    candidate.bbox.x += offset.x;
+    candidate.bbox.y += offset.y;
+    candidates->push_back(candidate);
+  }
+  return ball;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
@@ -0,0 +1,152 @@
+/*! @file
+ * Defines the ball detection stage, which turns a ball mask into a position, size
+ * and confidence.
+ */
+
+#ifndef SMM_BALL_DETECTOR_HPP
+#define SMM_BALL_DETECTOR_HPP
+
+#include <vector>
+#include <string>
+
+#include <opencv2/core.hpp>
+
+#include "bitMask.hpp"
+#include "runMask.hpp"
+#include "maskMoments.hpp"
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+/*! @brief Settings for the detection stage. */
+struct detectionSettings {
+  /*! @brief If nonzero, pixels in the background mask are removed from the ball mask first. */
+  int excludeBackground;
+
+  /*! @brief Smallest blob, in full-resolution pixels, that counts as the ball. */
+  double minArea;
+
+  /*! @brief @c "blobs" to take the largest blob as the ball, or @c "moments" to take
+   * all of the ball mask's pixels, whose moments the mask stage accumulates itself. */
+  std::string method;
+};
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+/*! @brief Where the ball is in one frame. All coordinates are in full-resolution pixels. */
+struct ballState {
+  /*! @brief @c True if a blob large enough to be the ball was found. */
+  bool found;
+
+  /*! @brief Centroid of the ball's pixels. */
+  cv::Point2f center;
+
+  /*! @brief Number of pixels in the ball. */
+  double area;
+
+  /*! @brief Bounding box of the ball. */
+  cv::Rect2f bbox;
+
+  /*! @brief 0 to 1; how round the blob is times its share of all masked pixels. */
+  float confidence;
+
+  /*! @brief Angle of the major axis of the ellipse with the ball's second moments, in
+   * radians from the x axis towards +y. */
+  float orientation;
+
+  /*! @brief Major and minor axis lengths of that ellipse; both the diameter for a round ball. */
+  cv::Size2f axes;
+
+  ballState() : found(false), area(0), confidence(0), orientation(0) {}
+};
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+/*! @brief Find the ball in a mask.
+ *
+ * The ball is taken to be the largest 8-connected blob.
+ *
+ * @param ballMask The 8-bit ball mask.
+ * @param bgMask The 8-bit background mask, or an empty Mat to use the ball mask as is.
+ * @param scaling The scale factor the masks were computed at, used to map the result
+ * back to full-resolution coordinates.
+ * @param s The detection settings.
+ *
+ * @returns The detected ball.
+ */
+struct ballState detectBall(const cv::Mat& ballMask, const cv::Mat& bgMask, double scaling,
+                            const struct detectionSettings& s);
+
+/*! @brief Find the ball in part of a packed mask.
+ *
+ * Same as the cv::Mat version, but the masks are never unpacked: the window is
+ * turned into runs, with the background removed word by word, and the blobs are
+ * found by joining runs. The cost grows with the number of runs, not pixels.
+ *
+ * @param ballMask The ball mask.
+ * @param bgMask The background mask, or @c NULL to use the ball mask as is.
+ * @param window The part of the masks to search.
+ * @param scaling The scale factor the masks were computed at.
+ * @param s The detection settings.
+ *
+ * @returns The detected ball, in full-resolution coordinates of the whole frame.
+ */
+struct ballState detectBall(const bitMask& ballMask, const bitMask* bgMask, cv::Rect window,
+                            double scaling, const struct detectionSettings& s);
+
+/*! @brief Take the ball to be all the pixels with the given moments.
+ *
+ * This needs no further look at the mask, so with moments accumulated while the mask
+ * is made, detection costs nothing per pixel. It suits masks that hold little but the
+ * ball: stray pixels pull the centroid and widen the ellipse, which lowers the
+ * confidence, but they aren't ignored the way smaller blobs are. The bounding box is
+ * the ellipse's.
+ *
+ * @param moments The moments of the mask, in mask pixels.
+ * @param scaling The scale factor the mask was computed at.
+ * @param s The detection settings.
+ *
+ * @returns The detected ball, in full-resolution coordinates.
+ */
+struct ballState detectBall(const struct maskMoments& moments, double scaling,
+                            const struct detectionSettings& s);
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+/*! @class ballDetector
+ * @brief The packed-mask detectBall() with buffers that are kept from frame to frame.
+ *
+ * After the first few frames the runs and blobs fit in the buffers of earlier frames,
+ * so detection stops allocating. One detector must not be used by two threads at once.
+ */
+class ballDetector {
+private:
+  runMask runs;
+  std::vector<struct maskBlob> blobs;
+  std::vector<size_t> order;
+
+public:
+  /*! @brief Find the ball in part of a packed mask; see detectBall().
+   *
+   * Optionally also lists the next largest blobs, for a finer stage to choose from
+   * when the mask's scale is too coarse to tell the ball from a blob of similar size.
+   *
+   * @param ballMask The ball mask.
+   * @param bgMask The background mask, or @c NULL to use the ball mask as is.
+   * @param window The part of the masks to search.
+   * @param scaling The scale factor the masks were computed at.
+   * @param s The detection settings.
+   * @param count The most candidates to list.
+   * @param candidates If not @c NULL, receives up to @c count blobs that are large
+   * enough to be the ball, largest first; the first is the ball returned. Its buffer
+   * is reused.
+   *
+   * @returns The detected ball.
+   */
+  struct ballState detect(const bitMask& ballMask, const bitMask* bgMask, cv::Rect window,
+                          double scaling, const struct detectionSettings& s,
+                          size_t count = 0, std::vector<struct ballState>* candidates = NULL);
+};
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#endif
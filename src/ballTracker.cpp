@@ -0,0 +1,140 @@
+#include <cmath>
+
+#include "ballTracker.hpp"
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// velocity variance for a freshly found ball: (1000 px/s)^2
+static const double initialVelocityVariance = 1e6;
+
+static double seconds(frameClock::duration d) {
+  return std::chrono::duration<double>(d).count();
+}
+
+static frameClock::duration fromMs(double ms) {
+  return std::chrono::duration_cast<frameClock::duration>(std::chrono::duration<double, std::milli>(ms));
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+ballTracker::ballTracker() :
+  stateMutex(),
+  initialized(false),
+  lastId(0),
+  lastTime(),
+  x(),
+  y(),
+  settings() {}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void ballTracker::predictAxis(struct axisState& a, double dt, double q) {
+  // F = [1 dt; 0 1], Q = q [dt^3/3 dt^2/2; dt^2/2 dt]
+  a.p += a.v * dt;
+  a.P00 += dt * (2*a.P01 + dt*a.P11) + q * dt*dt*dt / 3;
+  a.P01 += dt * a.P11 + q * dt*dt / 2;
+  a.P11 += q * dt;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void ballTracker::correctAxis(struct axisState& a, double z, double r) {
+  // H = [1 0]
+  double s = a.P00 + r*r;
+  double k0 = a.P00 / s;
+  double k1 = a.P01 / s;
+  double innovation = z - a.p;
+
+  a.p += k0 * innovation;
+  a.v += k1 * innovation;
+  a.P11 -= k1 * a.P01;
+  a.P01 -= k0 * a.P01;
+  a.P00 -= k0 * a.P00;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void ballTracker::update(const struct ballState& ball, unsigned long frameId,
+                         frameClock::time_point timestamp, const struct trackerSettings& s) {
+  stateMutex.lock();
+  if (frameId <= lastId) {
+    stateMutex.unlock();
+    return;
+  }
+  lastId = frameId;
+  settings = s;
+
+  // when the light actually hit the sensor
+  frameClock::time_point t = timestamp - fromMs(s.latency);
+
+  if (initialized && t - lastTime > fromMs(s.lostTimeout)) {
+    initialized = false;
+  }
+
+  if (!ball.found) {
+    stateMutex.unlock();
+    return;
+  }
+
+  if (!initialized) {
+    double r2 = s.measurementNoise * s.measurementNoise;
+    x.p = ball.center.x;
+    y.p = ball.center.y;
+    x.v = y.v = 0;
+    x.P00 = y.P00 = r2;
+    x.P01 = y.P01 = 0;
+    x.P11 = y.P11 = initialVelocityVariance;
+    initialized = true;
+  }
+  else {
+    double dt = seconds(t - lastTime);
+    if (dt > 0) {
+      predictAxis(x, dt, s.processNoise);
+      predictAxis(y, dt, s.processNoise);
+    }
+    correctAxis(x, ball.center.x, s.measurementNoise);
+    correctAxis(y, ball.center.y, s.measurementNoise);
+  }
+  lastTime = t;
+
+  stateMutex.unlock();
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+struct trackedBall ballTracker::predict(frameClock::time_point when) {
+  struct trackedBall ball;
+
+  stateMutex.lock();
+  if (!initialized || when - lastTime > fromMs(settings.lostTimeout)) {
+    stateMutex.unlock();
+    return ball;
+  }
+
+  // extrapolate a copy; the filter itself only moves on detections
+  struct axisState px = x, py = y;
+  double dt = seconds(when - lastTime);
+  if (dt > 0) {
+    predictAxis(px, dt, settings.processNoise);
+    predictAxis(py, dt, settings.processNoise);
+  }
+  stateMutex.unlock();
+
+  ball.valid = true;
+  ball.position = cv::Point2f((float) px.p, (float) py.p);
+  ball.velocity = cv::Point2f((float) px.v, (float) py.v);
+  ball.uncertainty = (float) std::sqrt(px.P00 + py.P00);
+  ball.horizon = dt * 1000;
+  return ball;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void ballTracker::reset() {
+  stateMutex.lock();
+  initialized = false;
+  lastId = 0;
+  stateMutex.unlock();
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
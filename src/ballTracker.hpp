@@ -0,0 +1,114 @@
+/*! @file
+ * Defines the ballTracker class, a constant-velocity Kalman filter over the ball
+ * detections that can predict where the ball is at any given moment.
+ */
+
+#ifndef SMM_BALL_TRACKER_HPP
+#define SMM_BALL_TRACKER_HPP
+
+#include <mutex>
+
+#include <opencv2/core.hpp>
+
+#include "capture.hpp"
+#include "ballDetector.hpp"
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+/*! @brief Settings for ballTracker. */
+struct trackerSettings {
+  /*! @brief Spectral density of the unmodelled acceleration, in px^2/s^3. Higher follows turns faster. */
+  double processNoise;
+
+  /*! @brief Standard deviation of a detection, in px. Higher smooths more. */
+  double measurementNoise;
+
+  /*! @brief Time from exposure to the frame's capture timestamp, in ms. */
+  double latency;
+
+  /*! @brief After this many ms without a detection the ball is considered lost. */
+  double lostTimeout;
+};
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+/*! @brief The tracker's estimate of the ball at some moment. Coordinates are in full-resolution pixels. */
+struct trackedBall {
+  /*! @brief @c False if the ball has not been seen yet or was lost. */
+  bool valid;
+
+  /*! @brief Estimated position. */
+  cv::Point2f position;
+
+  /*! @brief Estimated velocity, in px/s. */
+  cv::Point2f velocity;
+
+  /*! @brief Standard deviation of the position estimate, in px. */
+  float uncertainty;
+
+  /*! @brief How far the estimate was extrapolated past the last detection, in ms. */
+  double horizon;
+
+  trackedBall() : valid(false), uncertainty(0), horizon(0) {}
+};
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+/*! @class ballTracker
+ * @brief Filters timestamped ball detections and extrapolates them to any time.
+ *
+ * Each axis is an independent constant-velocity Kalman filter driven by white
+ * acceleration noise. Detections are stamped with the frame's capture time minus the
+ * configured latency, so predict() can compensate for the time the frame spent in the
+ * camera, the capture thread and the pipeline. All methods are thread-safe.
+ */
+class ballTracker {
+private:
+  // [position, velocity] and its covariance, per axis
+  struct axisState {
+    double p, v;
+    double P00, P01, P11;
+  };
+
+  static void predictAxis(struct axisState& a, double dt, double q);
+  static void correctAxis(struct axisState& a, double z, double r);
+
+  std::mutex stateMutex;
+  bool initialized;
+  unsigned long lastId;
+  frameClock::time_point lastTime;
+  struct axisState x, y;
+  struct trackerSettings settings;
+
+public:
+  /*! @brief ballTracker constructor. */
+  ballTracker();
+
+  /*! @brief Feed the detection for one frame.
+   *
+   * Frames at or before the last one fed are ignored, so the same frame may safely be
+   * passed more than once.
+   *
+   * @param ball The detection.
+   * @param frameId Id of the frame it came from.
+   * @param timestamp Capture time of the frame.
+   * @param s The tracker settings.
+   */
+  void update(const struct ballState& ball, unsigned long frameId,
+              frameClock::time_point timestamp, const struct trackerSettings& s);
+
+  /*! @brief Predict the ball at a given time.
+   *
+   * @param when The time to predict for; usually now, or when an output will take effect.
+   *
+   * @returns The estimate; not valid if the ball was never found or has been lost.
+   */
+  struct trackedBall predict(frameClock::time_point when);
+
+  /*! @brief Forget the ball. */
+  void reset();
+};
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#endif
@@ -0,0 +1,469 @@
+#include <cstring>
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "bitMask.hpp"
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+static const uint64_t allOnes = ~(uint64_t) 0;
+
+// the bits of a row's last word that hold pixels
+static uint64_t lastWordMask(int cols) {
+  return (cols & 63) ? ((uint64_t) 1 << (cols & 63)) - 1 : allOnes;
+}
+
+// bits [from, to) of a word, 0 <= from <= to <= 64
+static uint64_t bitRange(int from, int to) {
+  uint64_t high = to >= 64 ? allOnes : ((uint64_t) 1 << to) - 1;
+  uint64_t low = ((uint64_t) 1 << from) - 1;
+  return high & ~low;
+}
+
+static inline int popcount(uint64_t w) {
+#if defined(__GNUC__)
+  return __builtin_popcountll(w);
+#else
+  w = w - ((w >> 1) & 0x5555555555555555ULL);
+  w = (w & 0x3333333333333333ULL) + ((w >> 2) & 0x3333333333333333ULL);
+  w = (w + (w >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+  return (int) ((w * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+// writes pixels [x, x+n) of a packed row as bytes of 0 and 255
+static void unpackBits(const uint64_t* row, int x, int n, uchar* out) {
+  int i = 0;
+  while (i < n) {
+    int bit = (x + i) & 63;
+    uint64_t w = row[(x + i) >> 6] >> bit;
+    int run = std::min(64 - bit, n - i);
+    if (w == 0) {
+      std::memset(out + i, 0, run);
+    }
+    else {
+      for (int j = 0; j < run; j++, w >>= 1) {
+        out[i + j] = -(uchar) (w & 1);
+      }
+    }
+    i += run;
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+bitMask::bitMask() :
+  height(0),
+  width(0),
+  words(0),
+  bits(),
+  scratch() {}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+bitMask::bitMask(int rows, int cols) : bitMask() {
+  create(rows, cols);
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void bitMask::create(int rows, int cols) {
+  height = rows;
+  width = cols;
+  words = (cols + 63) / 64;
+  bits.assign((size_t) rows * words, 0);
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void bitMask::packRow(int y, const uchar* mask) {
+  uint64_t* r = row(y);
+  int x = 0;
+  for (int j = 0; j < words; j++) {
+    uint64_t w = 0;
+    int end = std::min(width, x + 64);
+#if defined(__SSE2__)
+    // 16 pixels at a time: compare with zero and gather the sign bits
+    if (end - x == 64) {
+      const __m128i zero = _mm_setzero_si128();
+      for (int k = 0; k < 4; k++) {
+        __m128i v = _mm_loadu_si128((const __m128i*) (mask + x + 16*k));
+        unsigned int zeros = _mm_movemask_epi8(_mm_cmpeq_epi8(v, zero));
+        w |= (uint64_t) (~zeros & 0xffff) << (16*k);
+      }
+      x = end;
+    }
+#endif
+    for (int bit = 0; x < end; x++, bit++) {
+      w |= (uint64_t) (mask[x] != 0) << bit;
+    }
+    r[j] = w;
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void bitMask::unpackRow(int y, uchar* mask) const {
+  unpackBits(row(y), 0, width, mask);
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void bitMask::copyRows(const bitMask& src, int srcY, int dstY, int count) {
+  CV_Assert(src.words == words);
+  if (count > 0) {
+    std::memcpy(row(dstY), src.row(srcY), (size_t) count * words * sizeof(uint64_t));
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+bitMask bitMask::fromMat(const cv::Mat& mat) {
+  CV_Assert(mat.type() == CV_8UC1);
+  bitMask m(mat.rows, mat.cols);
+  for (int y = 0; y < mat.rows; y++) {
+    m.packRow(y, mat.ptr<uchar>(y));
+  }
+  return m;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void bitMask::toMat(cv::Mat& mat) const {
+  toMat(mat, cv::Rect(0, 0, width, height));
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void bitMask::toMat(cv::Mat& mat, cv::Rect rect) const {
+  CV_Assert(rect.x >= 0 && rect.y >= 0 && rect.x + rect.width <= width && rect.y + rect.height <= height);
+  mat.create(rect.height, rect.width, CV_8UC1);
+  for (int y = 0; y < rect.height; y++) {
+    unpackBits(row(rect.y + y), rect.x, rect.width, mat.ptr<uchar>(y));
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void bitMask::morphStep(bool erode) {
+  if (empty()) {
+    return;
+  }
+
+  // outside the mask counts as set for erosion and clear for dilation, which is what
+  // cv::erode() and cv::dilate() do with their default border
+  uint64_t outside = erode ? allOnes : 0;
+  uint64_t last = lastWordMask(width);
+
+  // horizontal pass into scratch: each pixel combined with its left and right neighbours
+  scratch.resize(bits.size());
+  for (int y = 0; y < height; y++) {
+    const uint64_t* src = row(y);
+    uint64_t* dst = &scratch[(size_t) y * words];
+    uint64_t prev = outside;
+    uint64_t w = src[0];
+    for (int j = 0; j < words; j++) {
+      uint64_t next = j + 1 < words ? src[j + 1] : outside;
+      if (j == words - 1) {
+        w = (w & last) | (outside & ~last);
+      }
+      uint64_t left = (w << 1) | (prev >> 63);
+      uint64_t right = (w >> 1) | (next << 63);
+      dst[j] = erode ? (w & left & right) : (w | left | right);
+      prev = w;
+      w = next;
+    }
+  }
+
+  // vertical pass back into bits: each pixel combined with the rows above and below
+  for (int y = 0; y < height; y++) {
+    const uint64_t* above = y > 0 ? &scratch[(size_t) (y - 1) * words] : NULL;
+    const uint64_t* here = &scratch[(size_t) y * words];
+    const uint64_t* below = y + 1 < height ? &scratch[(size_t) (y + 1) * words] : NULL;
+    uint64_t* dst = row(y);
+    for (int j = 0; j < words; j++) {
+      uint64_t a = above ? above[j] : outside;
+      uint64_t b = below ? below[j] : outside;
+      dst[j] = erode ? (a & here[j] & b) : (a | here[j] | b);
+    }
+    dst[words - 1] &= last;
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void bitMask::erode(int iterations) {
+  for (int i = 0; i < iterations; i++) {
+    morphStep(true);
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void bitMask::dilate(int iterations) {
+  for (int i = 0; i < iterations; i++) {
+    morphStep(false);
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void bitMask::boxRows(bool erode, int radius) {
+  // van Herk/Gil-Werman down each column of words: the rows, padded with radius
+  // rows of the neutral value at both ends, are cut into blocks of 2*radius+1. A
+  // running AND (or OR) from each block's start and one from its end then give any
+  // window as one suffix combined with one prefix
+  uint64_t outside = erode ? allOnes : 0;
+  int window = 2*radius + 1;
+  int padded = height + 2*radius;
+  scratch.resize((size_t) 2 * padded * words);
+  uint64_t* prefix = scratch.data();
+  uint64_t* suffix = scratch.data() + (size_t) padded * words;
+
+  for (int e = 0; e < padded; e++) {
+    int y = e - radius;
+    uint64_t* p = prefix + (size_t) e * words;
+    for (int j = 0; j < words; j++) {
+      uint64_t w = y >= 0 && y < height ? row(y)[j] : outside;
+      if (e % window != 0) {
+        w = erode ? (w & p[j - words]) : (w | p[j - words]);
+      }
+      p[j] = w;
+    }
+  }
+  for (int e = padded - 1; e >= 0; e--) {
+    int y = e - radius;
+    uint64_t* q = suffix + (size_t) e * words;
+    for (int j = 0; j < words; j++) {
+      uint64_t w = y >= 0 && y < height ? row(y)[j] : outside;
+      if (e % window != window - 1 && e + 1 < padded) {
+        w = erode ? (w & q[j + words]) : (w | q[j + words]);
+      }
+      q[j] = w;
+    }
+  }
+
+  // row y covers padded rows y to y + 2*radius
+  for (int y = 0; y < height; y++) {
+    const uint64_t* q = suffix + (size_t) y * words;
+    const uint64_t* p = prefix + (size_t) (y + 2*radius) * words;
+    uint64_t* dst = row(y);
+    for (int j = 0; j < words; j++) {
+      dst[j] = erode ? (q[j] & p[j]) : (q[j] | p[j]);
+    }
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void bitMask::boxColumns(bool erode, int radius) {
+  // each row is copied between margins of the neutral value wide enough for the
+  // radius. Combining it with itself shifted by 1, 2, 4, ... pixels makes each bit
+  // cover the next `reach` pixels; two such spans, overlapping, cover the window
+  uint64_t outside = erode ? allOnes : 0;
+  uint64_t last = lastWordMask(width);
+  int window = 2*radius + 1;
+  int margin = (radius + 63) / 64;
+  int padded = words + 2*margin;
+  scratch.resize(padded);
+  uint64_t* ext = scratch.data();
+
+  // reads the 64 bits starting at bit position pos of ext
+  auto bitsAt = [&](long pos) {
+    long q = pos >> 6;
+    int b = (int) (pos & 63);
+    uint64_t lo = q < padded ? ext[q] : outside;
+    if (b == 0) {
+      return lo;
+    }
+    uint64_t hi = q + 1 < padded ? ext[q + 1] : outside;
+    return (lo >> b) | (hi << (64 - b));
+  };
+
+  int reach = 1;
+  while (reach * 2 <= window) {
+    reach *= 2;
+  }
+
+  for (int y = 0; y < height; y++) {
+    uint64_t* r = row(y);
+    for (int j = 0; j < padded; j++) {
+      ext[j] = j >= margin && j < margin + words ? r[j - margin] : outside;
+    }
+    ext[margin + words - 1] = (ext[margin + words - 1] & last) | (outside & ~last);
+
+    // in place from low to high words, so every read sees the previous round
+    for (int span = 1; span < reach; span *= 2) {
+      for (int j = 0; j < padded; j++) {
+        uint64_t shifted = bitsAt(64L*j + span);
+        ext[j] = erode ? (ext[j] & shifted) : (ext[j] | shifted);
+      }
+    }
+
+    // pixel x covers [x - radius, x + radius]: a span from each end
+    for (int j = 0; j < words; j++) {
+      long pos = 64L * (margin + j);
+      uint64_t a = bitsAt(pos - radius);
+      uint64_t b = bitsAt(pos + radius - reach + 1);
+      r[j] = erode ? (a & b) : (a | b);
+    }
+    r[words - 1] &= last;
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void bitMask::erodeBox(int radiusX, int radiusY) {
+  if (empty()) {
+    return;
+  }
+  if (radiusY > 0) {
+    boxRows(true, radiusY);
+  }
+  if (radiusX > 0) {
+    boxColumns(true, radiusX);
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void bitMask::dilateBox(int radiusX, int radiusY) {
+  if (empty()) {
+    return;
+  }
+  if (radiusY > 0) {
+    boxRows(false, radiusY);
+  }
+  if (radiusX > 0) {
+    boxColumns(false, radiusX);
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void bitMask::andWith(const bitMask& other) {
+  CV_Assert(other.height == height && other.width == width);
+  for (size_t i = 0; i < bits.size(); i++) {
+    bits[i] &= other.bits[i];
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void bitMask::andNot(const bitMask& other) {
+  CV_Assert(other.height == height && other.width == width);
+  for (size_t i = 0; i < bits.size(); i++) {
+    bits[i] &= ~other.bits[i];
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void bitMask::keepRect(cv::Rect rect) {
+  rect &= cv::Rect(0, 0, width, height);
+  if (rect.area() == 0) {
+    std::fill(bits.begin(), bits.end(), 0);
+    return;
+  }
+
+  // columns [x0, x1) are kept: the words between the first and last are whole, and
+  // those two are masked; computed here rather than per word so nothing is allocated
+  int x0 = rect.x, x1 = rect.x + rect.width;
+  int first = x0 / 64, last = (x1 - 1) / 64;
+  uint64_t firstKeep = bitRange(x0 - 64*first, first == last ? x1 - 64*first : 64);
+  uint64_t lastKeep = bitRange(0, x1 - 64*last);
+
+  for (int y = 0; y < height; y++) {
+    uint64_t* r = row(y);
+    if (y < rect.y || y >= rect.y + rect.height) {
+      std::fill(r, r + words, 0);
+      continue;
+    }
+    std::fill(r, r + first, 0);
+    r[first] &= firstKeep;
+    if (last != first) {
+      r[last] &= lastKeep;
+    }
+    std::fill(r + last + 1, r + words, 0);
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+long bitMask::count() const {
+  long n = 0;
+  for (uint64_t w : bits) {
+    n += popcount(w);
+  }
+  return n;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void bitMask::rowSums(int y, int x0, int x1, const bitMask* exclude,
+                      double& count, double& sumX, double& sumXX) const {
+  // bit b of plane[k] is set when bit k of b is: popcount(w & plane[k]) counts the
+  // pixels whose column has bit k set, and pairs of planes do the same for products
+  static const uint64_t plane[6] = {
+    0xaaaaaaaaaaaaaaaaULL, 0xccccccccccccccccULL, 0xf0f0f0f0f0f0f0f0ULL,
+    0xff00ff00ff00ff00ULL, 0xffff0000ffff0000ULL, 0xffffffff00000000ULL
+  };
+
+  const uint64_t* r = row(y);
+  const uint64_t* e = exclude ? exclude->row(y) : NULL;
+  long n = 0;
+  double sx = 0, sxx = 0;
+  for (int j = x0 >> 6; x0 < x1 && j <= (x1 - 1) >> 6; j++) {
+    uint64_t w = r[j] & bitRange(std::max(x0 - 64*j, 0), std::min(x1 - 64*j, 64));
+    if (e) {
+      w &= ~e[j];
+    }
+    if (w == 0) {
+      continue;
+    }
+
+    // sums over the bit positions within the word
+    long wn, wx, wxx;
+    if (w == allOnes) {
+      wn = 64;
+      wx = 63 * 64 / 2;
+      wxx = 63 * 64 * 127 / 6;
+    }
+    else {
+      int bits[6];
+      wn = popcount(w);
+      wx = 0;
+      wxx = 0;
+      for (int k = 0; k < 6; k++) {
+        bits[k] = popcount(w & plane[k]);
+        wx += (long) bits[k] << k;
+        wxx += (long) bits[k] << (2*k);
+      }
+      for (int k = 0; k < 6; k++) {
+        for (int l = k + 1; l < 6; l++) {
+          wxx += (long) popcount(w & plane[k] & plane[l]) << (k + l + 1);
+        }
+      }
+    }
+
+    // shifted to the word's first column
+    double offset = 64.0 * j;
+    n += wn;
+    sx += offset * wn + wx;
+    sxx += offset * offset * wn + 2 * offset * wx + wxx;
+  }
+  count = (double) n;
+  sumX = sx;
+  sumXX = sxx;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+bool bitMask::operator==(const bitMask& other) const {
+  return height == other.height && width == other.width && bits == other.bits;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
@@ -0,0 +1,178 @@
+/*! @file
+ * Defines the bitMask class, a binary mask stored one bit per pixel.
+ */
+
+#ifndef SMM_BIT_MASK_HPP
+#define SMM_BIT_MASK_HPP
+
+#include <vector>
+#include <cstdint>
+
+#include <opencv2/core.hpp>
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+/*! @class bitMask
+ * @brief A binary mask packed 64 pixels to a word.
+ *
+ * Pixel @c x of a row is bit <tt>x % 64</tt> of word <tt>x / 64</tt>. Each row starts
+ * on a new word, and the bits past the last column are always zero.
+ *
+ * erode() and dilate() give exactly the same result as cv::erode() and cv::dilate()
+ * with the default 3x3 kernel and border, but work on 64 pixels per instruction.
+ * erodeBox() and dilateBox() apply a whole rectangle at once, at a cost that barely
+ * depends on its size.
+ */
+class bitMask {
+private:
+  void morphStep(bool erode);
+  void boxRows(bool erode, int radius);
+  void boxColumns(bool erode, int radius);
+
+  int height;
+  int width;
+  int words;
+  std::vector<uint64_t> bits;
+  std::vector<uint64_t> scratch;
+
+public:
+  /*! @brief Construct an empty mask. */
+  bitMask();
+
+  /*! @brief Construct a cleared mask.
+   *
+   * @param rows Height in pixels.
+   * @param cols Width in pixels.
+   */
+  bitMask(int rows, int cols);
+
+  /*! @brief Resize and clear the mask. Storage is reused when it is large enough.
+   *
+   * @param rows Height in pixels.
+   * @param cols Width in pixels.
+   */
+  void create(int rows, int cols);
+
+  /*! @brief Returns the height in pixels. */
+  int rows() const { return height; }
+
+  /*! @brief Returns the width in pixels. */
+  int cols() const { return width; }
+
+  /*! @brief Returns the number of words in each row. */
+  int stride() const { return words; }
+
+  /*! @brief Returns @c True if the mask has no pixels. */
+  bool empty() const { return height == 0 || width == 0; }
+
+  /*! @brief Returns a pointer to the first word of a row. */
+  uint64_t* row(int y) { return &bits[(size_t) y * words]; }
+
+  /*! @brief Returns a pointer to the first word of a row. */
+  const uint64_t* row(int y) const { return &bits[(size_t) y * words]; }
+
+  /*! @brief Returns the value of one pixel. */
+  bool at(int y, int x) const { return (row(y)[x >> 6] >> (x & 63)) & 1; }
+
+  /*! @brief Set a row from bytes; any nonzero byte sets its pixel.
+   *
+   * @param y The row.
+   * @param mask Pointer to @c cols() bytes.
+   */
+  void packRow(int y, const uchar* mask);
+
+  /*! @brief Write a row out as bytes of 0 and 255.
+   *
+   * @param y The row.
+   * @param mask Pointer to @c cols() bytes.
+   */
+  void unpackRow(int y, uchar* mask) const;
+
+  /*! @brief Copy rows from another mask of the same width.
+   *
+   * @param src The mask to copy from.
+   * @param srcY First row to copy in @c src.
+   * @param dstY First row to write in this mask.
+   * @param count Number of rows.
+   */
+  void copyRows(const bitMask& src, int srcY, int dstY, int count);
+
+  /*! @brief Pack an 8-bit Mat; any nonzero pixel is set. */
+  static bitMask fromMat(const cv::Mat& mat);
+
+  /*! @brief Unpack to an 8-bit Mat of 0 and 255.
+   *
+   * @param mat Receives the mask. Its buffer is reused when the size matches.
+   */
+  void toMat(cv::Mat& mat) const;
+
+  /*! @brief Unpack part of the mask to an 8-bit Mat of 0 and 255.
+   *
+   * @param mat Receives the part of the mask inside @c rect.
+   * @param rect The part to unpack; must lie inside the mask.
+   */
+  void toMat(cv::Mat& mat, cv::Rect rect) const;
+
+  /*! @brief Erode with a 3x3 square, like cv::erode() with @c iterations. */
+  void erode(int iterations);
+
+  /*! @brief Dilate with a 3x3 square, like cv::dilate() with @c iterations. */
+  void dilate(int iterations);
+
+  /*! @brief Erode with a <tt>(2*radiusX+1) x (2*radiusY+1)</tt> rectangle in one pass.
+   *
+   * The vertical pass is van Herk/Gil-Werman: three word operations per word
+   * whatever the radius. The horizontal pass doubles its reach with each shift, so
+   * it costs <tt>log2(2*radiusX+1)</tt> word operations per word. erodeBox(n, n)
+   * gives the same result as erode(n).
+   *
+   * @param radiusX Pixels reached either side horizontally.
+   * @param radiusY Pixels reached either side vertically.
+   */
+  void erodeBox(int radiusX, int radiusY);
+
+  /*! @brief Dilate with a <tt>(2*radiusX+1) x (2*radiusY+1)</tt> rectangle in one pass.
+   *
+   * See erodeBox(); dilateBox(n, n) gives the same result as dilate(n).
+   *
+   * @param radiusX Pixels reached either side horizontally.
+   * @param radiusY Pixels reached either side vertically.
+   */
+  void dilateBox(int radiusX, int radiusY);
+
+  /*! @brief Clear every pixel not set in @c other, which must be the same size. */
+  void andWith(const bitMask& other);
+
+  /*! @brief Clear every pixel set in @c other, which must be the same size. */
+  void andNot(const bitMask& other);
+
+  /*! @brief Clear every pixel outside a rectangle. */
+  void keepRect(cv::Rect rect);
+
+  /*! @brief Returns the number of set pixels. */
+  long count() const;
+
+  /*! @brief Sum up the set pixels of part of a row, for image moments.
+   *
+   * Each word's sums come from popcounts of the word masked by the bit patterns of
+   * its column numbers, so the cost is per word rather than per pixel, and empty
+   * words are skipped.
+   *
+   * @param y The row.
+   * @param x0 First column.
+   * @param x1 One past the last column.
+   * @param exclude If not @c NULL, a mask of the same size whose set pixels are left out.
+   * @param count Receives the number of set pixels.
+   * @param sumX Receives the sum of their x coordinates.
+   * @param sumXX Receives the sum of their squared x coordinates.
+   */
+  void rowSums(int y, int x0, int x1, const bitMask* exclude,
+               double& count, double& sumX, double& sumXX) const;
+
+  /*! @brief Returns @c True if both masks are the same size and have the same pixels set. */
+  bool operator==(const bitMask& other) const;
+};
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#endif
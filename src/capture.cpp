@@ -0,0 +1,137 @@
+#include <iostream>
+#include <algorithm>
+
+#include "capture.hpp"
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+captureThread::captureThread() :
+  thread{},
+  running(false),
+  source(),
+  fast(false),
+  frames(),
+  frameCount(0),
+  readerMutex(),
+  frameMutex(),
+  frameSignal(),
+  publishedId(0) {}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+captureThread::~captureThread() {
+  shutdown();
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+bool captureThread::open(const struct sourceSettings& s) {
+  source = openFrameSource(s);
+  fast = s.fast != 0;
+  if (source) {
+    std::cout << "capturing from " << source->describe() << std::endl;
+  }
+  return (bool) source;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void captureThread::launch() {
+  running = true;
+  thread = std::thread{&captureThread::captureLoop, this};
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void captureThread::shutdown() {
+  running = false;
+  if (thread.joinable()) {
+    thread.join();
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+bool captureThread::isRunning() {
+  return running;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void captureThread::captureLoop() {
+  bool paced = !fast && !source->isLive() && source->fps() > 0;
+  frameClock::duration period(0);
+  if (paced) {
+    period = std::chrono::duration_cast<frameClock::duration>(std::chrono::duration<double>(1.0 / source->fps()));
+  }
+  frameClock::time_point deadline = frameClock::now();
+
+  while (running) {
+    capturedFrame& frame = frames.writeBuffer();
+    if (!source->read(frame.image)) {
+      if (!source->isLive()) {
+        std::cout << "end of " << source->describe() << "; stopping capture" << std::endl;
+        running = false;
+        return;
+      }
+      if (!source->isOpened()) {
+        std::cerr << "error: " << source->describe() << " closed; stopping capture" << std::endl;
+        running = false;
+        return;
+      }
+      // transient failure; don't spin on a camera that is not ready yet
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      continue;
+    }
+
+    if (paced) {
+      // don't try to catch up after a stall, just resume at the nominal rate
+      deadline = std::max(deadline + period, frameClock::now() - period);
+      std::this_thread::sleep_until(deadline);
+    }
+
+    frame.format = source->format();
+    frame.id = ++frameCount;
+    frame.timestamp = frameClock::now();
+    frame.hasTruth = source->groundTruth(&frame.truth);
+    frames.publish();
+
+    // the lock is only ever held briefly by waiters, so this never stalls capture
+    frameMutex.lock();
+    publishedId = frameCount;
+    frameMutex.unlock();
+    frameSignal.notify_all();
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+bool captureThread::latest(capturedFrame& frame) {
+  readerMutex.lock();
+  frames.update();
+
+  capturedFrame& newest = frames.readBuffer();
+  if (newest.id == 0) {
+    readerMutex.unlock();
+    return false;
+  }
+  if (newest.id != frame.id) {
+    newest.image.copyTo(frame.image);
+    frame.format = newest.format;
+    frame.id = newest.id;
+    frame.timestamp = newest.timestamp;
+    frame.hasTruth = newest.hasTruth;
+    frame.truth = newest.truth;
+  }
+  readerMutex.unlock();
+  return true;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+bool captureThread::waitForFrame(unsigned long id, frameClock::duration timeout) {
+  std::unique_lock<std::mutex> lock(frameMutex);
+  return frameSignal.wait_for(lock, timeout, [this, id] { return publishedId > id; });
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
@@ -0,0 +1,135 @@
+/*! @file
+ * Defines the captureThread class, which pulls frames from a frameSource on its own
+ * thread and hands the newest one to any reader without blocking the source.
+ */
+
+#ifndef SMM_CAPTURE_HPP
+#define SMM_CAPTURE_HPP
+
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#include <memory>
+
+#include <opencv2/core.hpp>
+
+#include "tripleBuffer.hpp"
+#include "frameSource.hpp"
+
+/*! @brief Helper typedef for the clock used to timestamp frames. */
+typedef std::chrono::steady_clock frameClock;
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+/*! @brief A single frame along with its capture metadata. */
+struct capturedFrame {
+  /*! @brief The image itself, laid out as @c format says. */
+  cv::Mat image;
+
+  /*! @brief The pixelFormat of @c image. */
+  int format;
+
+  /*! @brief Monotonically increasing frame number; 0 means "no frame". */
+  unsigned long id;
+
+  /*! @brief The time at which the frame was handed over by the source. */
+  frameClock::time_point timestamp;
+
+  /*! @brief @c True if the source supplied ground truth for this frame. */
+  bool hasTruth;
+
+  /*! @brief The true ball state, valid only if @c hasTruth is set. */
+  struct ballTruth truth;
+
+  capturedFrame() : format(pixelBgr), id(0), hasTruth(false) {}
+};
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+/*! @class captureThread
+ * @brief Grabs frames at full source rate on a dedicated thread.
+ *
+ * Frames are written into a lock-free triple buffer, so the source never waits on a
+ * reader. Readers copy out the newest complete frame with latest(); they only ever
+ * contend with each other, never with the source or with the global settings mutex.
+ *
+ * Live cameras pace themselves. Recorded and synthetic sources are throttled to their
+ * nominal frame rate, unless fast playback was requested.
+ */
+class captureThread {
+private:
+  void captureLoop();
+
+  std::thread thread;
+  std::atomic<bool> running;
+
+  std::unique_ptr<frameSource> source;
+  bool fast;
+  tripleBuffer<capturedFrame> frames;
+  unsigned long frameCount;
+
+  std::mutex readerMutex;
+
+  std::mutex frameMutex;
+  std::condition_variable frameSignal;
+  unsigned long publishedId;
+
+public:
+  /*! @brief captureThread constructor. */
+  captureThread();
+
+  /*! @brief captureThread destructor.
+   *
+   * The destructor stops the capture thread and releases the source.
+   */
+  ~captureThread();
+
+  /*! @brief Open a frame source.
+   *
+   * @param s Settings describing the source to open.
+   *
+   * @returns @c True if the source was opened; @c False otherwise.
+   */
+  bool open(const struct sourceSettings& s);
+
+  /*! @brief Start capturing frames. */
+  void launch();
+
+  /*! @brief Stop capturing frames. */
+  void shutdown();
+
+  /*! @brief Returns the current state.
+   *
+   * @returns @c True if the capture thread is running; @c False otherwise.
+   */
+  bool isRunning();
+
+  /*! @brief Copy the newest complete frame.
+   *
+   * If @c frame already holds the newest frame, nothing is copied. The pixel data is
+   * copied into @c frame's existing buffer when the sizes match, so reusing the same
+   * capturedFrame across calls avoids reallocating.
+   *
+   * @param frame The frame to copy into.
+   *
+   * @returns @c True if @c frame now holds a frame; @c False if nothing has been
+   * captured yet.
+   */
+  bool latest(capturedFrame& frame);
+
+  /*! @brief Wait for a frame newer than a given one.
+   *
+   * @param id Id of the last frame the caller has seen.
+   * @param timeout How long to wait at most.
+   *
+   * @returns @c True if a newer frame is available; @c False on timeout.
+   */
+  bool waitForFrame(unsigned long id, frameClock::duration timeout);
+};
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#endif
@@ -0,0 +1,51 @@
+#include "encodedCache.hpp"
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+encodedCache::encodedCache() :
+  cacheMutex(),
+  frameId(0),
+  settingsVersion(0),
+  entries() {}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+std::shared_ptr<const std::string> encodedCache::find(unsigned long frameId, unsigned long settingsVersion,
+                                                      const std::string& output, const std::string& format) {
+  std::shared_ptr<const std::string> encoded;
+
+  cacheMutex.lock();
+  if (frameId == this->frameId && settingsVersion == this->settingsVersion) {
+    std::map<std::string, std::shared_ptr<const std::string>>::iterator i = entries.find(output + "/" + format);
+    if (i != entries.end()) {
+      encoded = i->second;
+    }
+  }
+  cacheMutex.unlock();
+
+  return encoded;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void encodedCache::store(unsigned long frameId, unsigned long settingsVersion,
+                         const std::string& output, const std::string& format,
+                         std::shared_ptr<const std::string> encoded) {
+  cacheMutex.lock();
+
+  // an encoder that finished after a newer frame arrived has nothing useful to add
+  bool older = frameId < this->frameId ||
+    (frameId == this->frameId && settingsVersion < this->settingsVersion);
+  if (!older) {
+    if (frameId != this->frameId || settingsVersion != this->settingsVersion) {
+      entries.clear();
+      this->frameId = frameId;
+      this->settingsVersion = settingsVersion;
+    }
+    entries[output + "/" + format] = encoded;
+  }
+
+  cacheMutex.unlock();
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
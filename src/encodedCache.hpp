@@ -0,0 +1,62 @@
+/*! @file
+ * Defines the encodedCache class, which remembers encoded replies for the newest
+ * frame so repeated requests don't re-encode them.
+ */
+
+#ifndef SMM_ENCODED_CACHE_HPP
+#define SMM_ENCODED_CACHE_HPP
+
+#include <string>
+#include <map>
+#include <memory>
+#include <mutex>
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+/*! @class encodedCache
+ * @brief Encoded outputs keyed by (frame id, settings version, output, format).
+ *
+ * Only entries for the newest frame id and settings version are kept; storing an
+ * entry for a newer pair drops everything older, and entries for an older pair are
+ * ignored. Entries are shared, immutable strings, so a hit costs a map lookup and a
+ * reference count rather than a copy.
+ */
+class encodedCache {
+private:
+  std::mutex cacheMutex;
+  unsigned long frameId;
+  unsigned long settingsVersion;
+  std::map<std::string, std::shared_ptr<const std::string>> entries;
+
+public:
+  /*! @brief encodedCache constructor. */
+  encodedCache();
+
+  /*! @brief Look up an encoded output.
+   *
+   * @param frameId Id of the frame the output was computed from.
+   * @param settingsVersion Settings version the output was computed with.
+   * @param output Name of the output, e.g. @c "ballMask".
+   * @param format Name of the encoding, e.g. @c "jpeg-base64".
+   *
+   * @returns The encoded bytes, or an empty pointer on a miss.
+   */
+  std::shared_ptr<const std::string> find(unsigned long frameId, unsigned long settingsVersion,
+                                          const std::string& output, const std::string& format);
+
+  /*! @brief Remember an encoded output.
+   *
+   * @param frameId Id of the frame the output was computed from.
+   * @param settingsVersion Settings version the output was computed with.
+   * @param output Name of the output.
+   * @param format Name of the encoding.
+   * @param encoded The encoded bytes.
+   */
+  void store(unsigned long frameId, unsigned long settingsVersion,
+             const std::string& output, const std::string& format,
+             std::shared_ptr<const std::string> encoded);
+};
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#endif
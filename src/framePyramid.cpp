@@ -0,0 +1,169 @@
+#include <opencv2/imgproc.hpp>
+
+#include "framePyramid.hpp"
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+framePyramid::framePyramid() :
+  levelsMutex(),
+  base(),
+  baseFormat(pixelBgr),
+  frameId(0),
+  levels(),
+  planes() {}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void framePyramid::assign(const capturedFrame& frame) {
+  levelsMutex.lock();
+  frame.image.copyTo(base);
+  baseFormat = frame.format;
+  frameId = frame.id;
+  for (size_t i = 0; i < levels.size(); i++) {
+    levels[i].filled = false;
+  }
+  levelsMutex.unlock();
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+unsigned long framePyramid::id() {
+  levelsMutex.lock();
+  unsigned long i = frameId;
+  levelsMutex.unlock();
+  return i;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+int framePyramid::format() {
+  levelsMutex.lock();
+  int f = baseFormat;
+  levelsMutex.unlock();
+  return f;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+cv::Mat framePyramid::frame() {
+  levelsMutex.lock();
+  cv::Mat image = base;
+  levelsMutex.unlock();
+  return image;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+cv::Mat framePyramid::level(double scaling) {
+  levelsMutex.lock();
+  cv::Mat image = fill(scaling, false);
+  levelsMutex.unlock();
+  return image;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+cv::Mat framePyramid::bgr(double scaling) {
+  levelsMutex.lock();
+  cv::Mat image = fill(scaling, true);
+  levelsMutex.unlock();
+  return image;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+cv::Mat framePyramid::cached(double scaling) {
+  cv::Mat image;
+  levelsMutex.lock();
+  if (scaling == 1 && baseFormat == pixelBgr) {
+    image = base;
+  }
+  else {
+    int i = findLevel(scaling, false, true);
+    if (i >= 0) {
+      image = levels[i].image;
+    }
+  }
+  levelsMutex.unlock();
+  return image;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+int framePyramid::findLevel(double scaling, bool bgr, bool filled) {
+  for (size_t i = 0; i < levels.size(); i++) {
+    if (levels[i].scaling == scaling && levels[i].bgr == bgr && levels[i].filled == filled) {
+      return (int) i;
+    }
+  }
+  return -1;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+cv::Mat framePyramid::fill(double scaling, bool bgr) {
+  // a BGR frame's own layout is BGR, and at full size it is the frame itself
+  if (baseFormat == pixelBgr) {
+    bgr = false;
+    if (scaling == 1) {
+      return base;
+    }
+  }
+  int i = findLevel(scaling, bgr, true);
+  if (i >= 0) {
+    return levels[i].image;
+  }
+
+  // the source is found before the level's slot is taken, since taking a new slot
+  // may move the others
+  cv::Mat source;
+  double sourceScaling = 0;
+  if (bgr) {
+    if (scaling != 1) {
+      source = fill(scaling, false);
+    }
+  }
+  else {
+    for (size_t j = 0; j < levels.size(); j++) {
+      if (levels[j].filled && !levels[j].bgr && levels[j].scaling > scaling &&
+          (sourceScaling == 0 || levels[j].scaling < sourceScaling)) {
+        source = levels[j].image;
+        sourceScaling = levels[j].scaling;
+      }
+    }
+  }
+
+  // a slot that held this level for an earlier frame keeps its buffer
+  i = findLevel(scaling, bgr, false);
+  if (i < 0) {
+    struct pyramidLevel fresh;
+    fresh.scaling = scaling;
+    fresh.bgr = bgr;
+    fresh.filled = false;
+    levels.push_back(fresh);
+    i = (int) levels.size() - 1;
+  }
+  struct pyramidLevel& l = levels[i];
+
+  cv::Size full = frameSize(base, baseFormat);
+  if (bgr && scaling == 1) {
+    frameToBgr(base, baseFormat, l.image);
+  }
+  else if (bgr) {
+    yuvToBgr(source, l.image);
+  }
+  else if (!source.empty()) {
+    cv::Size size(cvRound(full.width * scaling), cvRound(full.height * scaling));
+    cv::resize(source, l.image, size, 0, 0, cv::INTER_AREA);
+  }
+  else if (baseFormat == pixelBgr) {
+    cv::resize(base, l.image, cv::Size(), scaling, scaling, cv::INTER_AREA);
+  }
+  else {
+    scaleYuv(base, baseFormat, scaling, l.image, planes);
+  }
+  l.filled = true;
+  return l.image;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
@@ -0,0 +1,107 @@
+/*! @file
+ * Defines the framePyramid class, which holds one captured frame and the scaled
+ * copies of it that have been asked for, each computed at most once.
+ */
+
+#ifndef SMM_FRAME_PYRAMID_HPP
+#define SMM_FRAME_PYRAMID_HPP
+
+#include <vector>
+#include <mutex>
+
+#include <opencv2/core.hpp>
+
+#include "capture.hpp"
+#include "pixelFormat.hpp"
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+/*! @class framePyramid
+ * @brief A frame and its scaled copies, filled in lazily.
+ *
+ * A level is computed the first time it is asked for and kept until the next frame
+ * is assigned, so every consumer of a size (the mask stage, the preview, the ball
+ * refinement, thumbnails and snapshots for clients) shares one copy, and sizes no
+ * one asks for cost nothing.
+ *
+ * Levels come in the frame's own layout, BGR or packed Y U V as from scaleYuv(), or
+ * in BGR. Every level is shrunk with area averaging, from the smallest larger level
+ * already computed or, failing that, from the frame itself, as the mask stage always
+ * does for its first level. Either way each pixel averages the frame pixels it
+ * covers, so a level doesn't alias when it was made first and hardly changes with
+ * which sizes were asked for before it.
+ *
+ * Level buffers are kept when the next frame is assigned, so a pyramid asked for the
+ * same scales every frame stops allocating. Scales should therefore come from a
+ * small set. All methods may be called from any thread; a level is computed under
+ * the pyramid's lock, so concurrent requests for it wait for one computation.
+ */
+class framePyramid {
+private:
+  struct pyramidLevel {
+    double scaling;
+    bool bgr;
+    bool filled;
+    cv::Mat image;
+  };
+
+  std::mutex levelsMutex;
+  cv::Mat base;
+  int baseFormat;
+  unsigned long frameId;
+  std::vector<struct pyramidLevel> levels;
+  struct yuvScratch planes;
+
+  int findLevel(double scaling, bool bgr, bool filled);
+  cv::Mat fill(double scaling, bool bgr);
+
+public:
+  /*! @brief framePyramid constructor. */
+  framePyramid();
+
+  /*! @brief Take a new frame, dropping the levels of the previous one.
+   *
+   * The frame's pixels are copied into a buffer the pyramid keeps.
+   *
+   * @param frame The frame.
+   */
+  void assign(const capturedFrame& frame);
+
+  /*! @brief Returns the id of the frame, 0 if none was assigned. */
+  unsigned long id();
+
+  /*! @brief Returns the pixelFormat of the frame. */
+  int format();
+
+  /*! @brief Returns the full-resolution frame, laid out as format() says. */
+  cv::Mat frame();
+
+  /*! @brief Get the frame scaled, in its own layout.
+   *
+   * @param scaling Scale factor, as for cv::resize().
+   *
+   * @returns An 8-bit, 3-channel image, BGR for BGR frames and packed Y U V for YUV
+   * frames; valid until the next frame is assigned.
+   */
+  cv::Mat level(double scaling);
+
+  /*! @brief Get the frame scaled and in BGR.
+   *
+   * @param scaling Scale factor, as for cv::resize().
+   *
+   * @returns The 8-bit, 3-channel BGR image; valid until the next frame is assigned.
+   */
+  cv::Mat bgr(double scaling);
+
+  /*! @brief Get a level in the frame's own layout only if it was already computed.
+   *
+   * @param scaling Scale factor.
+   *
+   * @returns The image, or an empty Mat. At scale 1 a BGR frame is always there.
+   */
+  cv::Mat cached(double scaling);
+};
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#endif
@@ -0,0 +1,274 @@
+#include <iostream>
+#include <algorithm>
+
+#include <opencv2/imgproc.hpp>
+#include <opencv2/imgcodecs.hpp>
+
+#include "frameSource.hpp"
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void defaultSourceSettings(struct sourceSettings* s) {
+  s->type   = "camera";
+  s->camera = 1;
+  s->path   = "";
+  s->fps    = 30;
+  s->fast   = 0;
+  s->loop   = 1;
+  s->width  = 640;
+  s->height = 480;
+  defaultSceneSettings(&s->scene);
+  s->format = "bgr";
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+std::unique_ptr<frameSource> openFrameSource(const struct sourceSettings& s) {
+  std::unique_ptr<frameSource> source;
+
+  int format = pixelBgr;
+  if (!parsePixelFormat(s.format, format)) {
+    std::cerr << "error: unknown pixel format '" << s.format << "'" << std::endl;
+    return source;
+  }
+
+  if (s.type == "camera") {
+    source.reset(new cameraSource(s.camera, format));
+  }
+  else if (s.type == "video") {
+    source.reset(new videoFileSource(s.path, s.fps, s.loop != 0));
+  }
+  else if (s.type == "images") {
+    source.reset(new imageSequenceSource(s.path, s.fps, s.loop != 0));
+  }
+  else if (s.type == "synthetic") {
+    source.reset(new syntheticSource(s.scene, cv::Size(s.width, s.height), s.fps, format));
+  }
+  else {
+    std::cerr << "error: unknown frame source type '" << s.type << "'" << std::endl;
+    return source;
+  }
+
+  if (!source->isOpened()) {
+    std::cerr << "error: could not open " << source->describe() << std::endl;
+    source.reset();
+  }
+  return source;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+cameraSource::cameraSource(int index, int format) :
+  camera(index),
+  index(index),
+  requested(format),
+  delivered(pixelBgr),
+  gray(),
+  grayFrames(false) {
+  if (format == pixelYuyv || format == pixelNv12) {
+    int fourcc = format == pixelYuyv ? cv::VideoWriter::fourcc('Y', 'U', 'Y', 'V')
+                                     : cv::VideoWriter::fourcc('N', 'V', '1', '2');
+    camera.set(cv::CAP_PROP_FOURCC, fourcc);
+    camera.set(cv::CAP_PROP_CONVERT_RGB, 0);
+  }
+}
+
+cameraSource::~cameraSource() {
+  camera.release();
+}
+
+bool cameraSource::isOpened() {
+  return camera.isOpened();
+}
+
+bool cameraSource::read(cv::Mat& image) {
+  // once the camera has sent gray frames they are read into a scratch Mat and
+  // expanded into image, so image keeps one BGR buffer rather than flipping type
+  cv::Mat& raw = grayFrames ? gray : image;
+  if (!camera.read(raw) || raw.empty()) {
+    return false;
+  }
+  if (grayFrames && raw.type() != CV_8UC1) {
+    grayFrames = false;
+    std::swap(gray, image);
+  }
+  // what actually arrived: the backend may not have honoured the requested format
+  if (image.type() == CV_8UC2) {
+    delivered = pixelYuyv;
+  }
+  else if (raw.type() == CV_8UC1 && requested == pixelNv12) {
+    delivered = pixelNv12;
+  }
+  else if (raw.type() == CV_8UC1) {
+    // some backends only deliver gray frames; the pipeline takes BGR, so expand them
+    if (!grayFrames) {
+      std::cerr << "warning: " << describe() << " delivers gray frames; converting them to BGR" << std::endl;
+      grayFrames = true;
+      std::swap(gray, image);
+    }
+    cv::cvtColor(gray, image, cv::COLOR_GRAY2BGR);
+    delivered = pixelBgr;
+  }
+  else if (image.type() == CV_8UC3) {
+    delivered = pixelBgr;
+  }
+  else {
+    // retrying would only get the same frames again; closing the camera makes the
+    // capture loop stop instead of spinning
+    std::cerr << "error: " << describe() << " delivers unsupported frames of type "
+              << image.type() << "; closing it" << std::endl;
+    camera.release();
+    return false;
+  }
+  return true;
+}
+
+double cameraSource::fps() {
+  return camera.get(cv::CAP_PROP_FPS);
+}
+
+std::string cameraSource::describe() {
+  return "camera " + std::to_string(index);
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+videoFileSource::videoFileSource(std::string path, double frameRate, bool loop) :
+  video(path),
+  path(path),
+  frameRate(frameRate),
+  loop(loop) {
+  // prefer the rate recorded in the file, if it has one
+  double fileRate = video.get(cv::CAP_PROP_FPS);
+  if (fileRate > 0) {
+    this->frameRate = fileRate;
+  }
+}
+
+videoFileSource::~videoFileSource() {
+  video.release();
+}
+
+bool videoFileSource::isOpened() {
+  return video.isOpened();
+}
+
+bool videoFileSource::read(cv::Mat& image) {
+  if (video.read(image) && !image.empty()) {
+    return true;
+  }
+  if (!loop) {
+    return false;
+  }
+  // rewind; reopen if the backend cannot seek
+  if (!video.set(cv::CAP_PROP_POS_FRAMES, 0)) {
+    video.open(path);
+  }
+  return video.read(image) && !image.empty();
+}
+
+double videoFileSource::fps() {
+  return frameRate;
+}
+
+std::string videoFileSource::describe() {
+  return "video file '" + path + "'";
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+imageSequenceSource::imageSequenceSource(std::string path, double frameRate, bool loop) :
+  files(),
+  path(path),
+  next(0),
+  frameRate(frameRate),
+  loop(loop) {
+  std::string pattern = path;
+  if (pattern.find('*') == std::string::npos && pattern.find('?') == std::string::npos) {
+    pattern += "/*";
+  }
+  try {
+    cv::glob(pattern, files, false);
+  }
+  catch (cv::Exception& error) {
+    std::cerr << "error: could not list '" << pattern << "': " << error.what() << std::endl;
+  }
+  std::sort(files.begin(), files.end());
+}
+
+bool imageSequenceSource::isOpened() {
+  return !files.empty();
+}
+
+bool imageSequenceSource::read(cv::Mat& image) {
+  // skip over anything that does not decode as an image
+  for (size_t attempts = 0; attempts < files.size(); attempts++) {
+    if (next >= files.size()) {
+      if (!loop) {
+        return false;
+      }
+      next = 0;
+    }
+    image = cv::imread(files[next++], cv::IMREAD_COLOR);
+    if (!image.empty()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+double imageSequenceSource::fps() {
+  return frameRate;
+}
+
+std::string imageSequenceSource::describe() {
+  return "image sequence '" + path + "' (" + std::to_string(files.size()) + " files)";
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+syntheticSource::syntheticSource(const struct sceneSettings& s, cv::Size size, double frameRate, int format) :
+  scene(s, size, frameRate),
+  size(size),
+  frameRate(frameRate > 0 ? frameRate : 30),
+  pixels(format),
+  rendered(),
+  frameCount(0) {
+  truth.visible = false;
+}
+
+bool syntheticSource::isOpened() {
+  // YUV frames share chroma between pairs of columns (and rows, for NV12)
+  bool even = (pixels == pixelBgr || size.width % 2 == 0) && (pixels != pixelNv12 || size.height % 2 == 0);
+  return size.width > 0 && size.height > 0 && even;
+}
+
+bool syntheticSource::read(cv::Mat& image) {
+  if (pixels == pixelBgr) {
+    scene.render(frameCount++, image, &truth);
+  }
+  else {
+    scene.render(frameCount++, rendered, &truth);
+    bgrToFrame(rendered, pixels, image);
+  }
+  return true;
+}
+
+double syntheticSource::fps() {
+  return frameRate;
+}
+
+bool syntheticSource::groundTruth(struct ballTruth* truth) {
+  *truth = this->truth;
+  return true;
+}
+
+std::string syntheticSource::describe() {
+  std::string description = "synthetic " + std::to_string(size.width) + "x" + std::to_string(size.height) + " scene";
+  if (pixels != pixelBgr) {
+    description += std::string(" in ") + pixelFormatName(pixels);
+  }
+  return description;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
@@ -0,0 +1,222 @@
+/*! @file
+ * Defines the frameSource interface and its backends: a live camera, a video file,
+ * a directory of still images, and a synthetic scene generator. These let the vision
+ * pipeline run (and be benchmarked) on machines with no camera attached.
+ */
+
+#ifndef SMM_FRAME_SOURCE_HPP
+#define SMM_FRAME_SOURCE_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+
+#include <opencv2/core.hpp>
+#include <opencv2/videoio.hpp>
+
+#include "syntheticScene.hpp"
+#include "pixelFormat.hpp"
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+/*! @brief Settings selecting and configuring a frame source. */
+struct sourceSettings {
+  /*! @brief One of @c camera, @c video, @c images or @c synthetic. */
+  std::string type;
+  /*! @brief Camera index, used by the @c camera source. */
+  int camera;
+  /*! @brief File, directory or glob pattern used by the @c video and @c images sources. */
+  std::string path;
+  /*! @brief Playback rate for recorded and synthetic sources, in frames per second. */
+  double fps;
+  /*! @brief If nonzero, deliver recorded and synthetic frames as fast as possible. */
+  int fast;
+  /*! @brief If nonzero, restart recorded sources when they run out of frames. */
+  int loop;
+  /*! @brief Frame width used by the @c synthetic source. */
+  int width;
+  /*! @brief Frame height used by the @c synthetic source. */
+  int height;
+  /*! @brief Scene description used by the @c synthetic source. */
+  struct sceneSettings scene;
+  /*! @brief Pixel format to deliver, @c bgr, @c yuyv or @c nv12; used by the @c camera
+   * and @c synthetic sources. */
+  std::string format;
+};
+
+/*! @brief Fill a sourceSettings struct with the defaults (camera 1, 30 fps, looping, BGR). */
+void defaultSourceSettings(struct sourceSettings* s);
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+/*! @brief Abstract source of frames, in BGR or a camera's native YUV. */
+class frameSource {
+public:
+  virtual ~frameSource() {}
+
+  /*! @brief Returns @c True if the source is ready to deliver frames. */
+  virtual bool isOpened() = 0;
+
+  /*! @brief Read the next frame.
+   *
+   * @param image The Mat to read into. Its buffer is reused when the size matches.
+   *
+   * @returns @c True on success; @c False if the source has run out of frames or failed.
+   */
+  virtual bool read(cv::Mat& image) = 0;
+
+  /*! @brief Returns the pixelFormat of the frame read() delivered last. */
+  virtual int format() { return pixelBgr; }
+
+  /*! @brief Returns @c True if the source paces itself (i.e. it is a live camera).
+   *
+   * Sources that do not pace themselves are throttled to their nominal frame rate
+   * by the reader unless fast playback was requested.
+   */
+  virtual bool isLive() { return false; }
+
+  /*! @brief Nominal frame rate of the source, or 0 if unknown. */
+  virtual double fps() = 0;
+
+  /*! @brief Get the true ball state for the most recently read frame.
+   *
+   * @param truth Receives the ball state.
+   *
+   * @returns @c True if the source knows the ground truth (i.e. it is synthetic);
+   * @c False otherwise.
+   */
+  virtual bool groundTruth(struct ballTruth* truth) { return false; }
+
+  /*! @brief Human-readable description, for log messages. */
+  virtual std::string describe() = 0;
+};
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+/*! @brief A live camera opened through cv::VideoCapture.
+ *
+ * Asked for YUYV or NV12, the camera is switched to that format and OpenCV's
+ * conversion to BGR is turned off, so frames arrive as the camera sends them. Backends
+ * that ignore the request keep delivering BGR, and format() says so. Gray frames
+ * that weren't asked for are converted to BGR. Frames of any other type close the
+ * camera, which stops capture.
+ */
+class cameraSource : public frameSource {
+private:
+  cv::VideoCapture camera;
+  int index;
+  int requested;
+  int delivered;
+  cv::Mat gray;
+  bool grayFrames;
+
+public:
+  /*! @param index The index of the camera to open.
+   *  @param format The pixelFormat to ask the camera for.
+   */
+  cameraSource(int index, int format);
+  ~cameraSource();
+
+  bool isOpened();
+  bool read(cv::Mat& image);
+  int format() { return delivered; }
+  bool isLive() { return true; }
+  double fps();
+  std::string describe();
+};
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+/*! @brief A recorded video file, optionally looping. */
+class videoFileSource : public frameSource {
+private:
+  cv::VideoCapture video;
+  std::string path;
+  double frameRate;
+  bool loop;
+
+public:
+  /*! @param path The video file to play.
+   *  @param frameRate Playback rate to use if the file does not specify one.
+   *  @param loop Restart from the first frame at the end of the file.
+   */
+  videoFileSource(std::string path, double frameRate, bool loop);
+  ~videoFileSource();
+
+  bool isOpened();
+  bool read(cv::Mat& image);
+  double fps();
+  std::string describe();
+};
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+/*! @brief A sorted sequence of still images, optionally looping. */
+class imageSequenceSource : public frameSource {
+private:
+  std::vector<std::string> files;
+  std::string path;
+  size_t next;
+  double frameRate;
+  bool loop;
+
+public:
+  /*! @param path A directory, or a glob pattern such as <tt>frames/img_*.png</tt>.
+   *  @param frameRate Playback rate.
+   *  @param loop Restart from the first image after the last one.
+   */
+  imageSequenceSource(std::string path, double frameRate, bool loop);
+
+  bool isOpened();
+  bool read(cv::Mat& image);
+  double fps();
+  std::string describe();
+};
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+/*! @brief A rendered syntheticScene, with ground truth for every frame.
+ *
+ * Frames can be delivered as YUYV or NV12, converted from the render, to exercise
+ * the YUV path without a camera.
+ */
+class syntheticSource : public frameSource {
+private:
+  syntheticScene scene;
+  cv::Size size;
+  double frameRate;
+  int pixels;
+  cv::Mat rendered;
+  unsigned long frameCount;
+  struct ballTruth truth;
+
+public:
+  /*! @param s The scene to render.
+   *  @param size The frame size to render.
+   *  @param frameRate Nominal frame rate, used to advance the animation.
+   *  @param format The pixelFormat to deliver.
+   */
+  syntheticSource(const struct sceneSettings& s, cv::Size size, double frameRate, int format);
+
+  bool isOpened();
+  bool read(cv::Mat& image);
+  int format() { return pixels; }
+  double fps();
+  bool groundTruth(struct ballTruth* truth);
+  std::string describe();
+};
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+/*! @brief Construct the frame source described by some settings.
+ *
+ * @param s The source settings.
+ *
+ * @returns The opened source, or an empty pointer if the type is unknown or the
+ * source could not be opened.
+ */
+std::unique_ptr<frameSource> openFrameSource(const struct sourceSettings& s);
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#endif
@@ -0,0 +1,529 @@
+#include <vector>
+#include <algorithm>
+
+#include <opencv2/imgproc.hpp>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SMM_HSV_AVX2
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SMM_HSV_SSE2
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define SMM_HSV_NEON
+#endif
+
+#include "hsvThreshold.hpp"
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+/* The conversion mirrors OpenCV's 8-bit BGR2HSV exactly:
+ *
+ *   v = max(b,g,r), diff = v - min(b,g,r)
+ *   s = (diff * sdiv[v] + 2048) >> 12         sdiv[i] = round((255 << 12) / i)
+ *   h = (num * hdiv[diff] + 2048) >> 12       hdiv[i] = round((180 << 12) / (6 * i))
+ *   h += 180 if h < 0
+ *
+ * where num is g-b, b-r+2*diff or r-g+4*diff depending on which channel is the
+ * maximum, and round() is round-half-to-even. The vector paths compute the two
+ * table entries with a float division instead of a gather, then correct the
+ * rounding with an exact integer-valued residual, so every lane matches the table.
+ * All intermediate products stay below 2^24 and are therefore exact in float.
+ */
+
+static const int hsvShift = 12;
+static const int sdivNumerator = 255 << hsvShift;        // 1044480
+static const int hdivNumerator = (180 << hsvShift) / 6;  // 122880
+
+// bounds kept in registers per pass of hsvThresholdRowMulti()
+static const int hsvMaxProfiles = 8;
+
+struct hsvTables {
+  int sdiv[256];
+  int hdiv[256];
+
+  hsvTables() {
+    sdiv[0] = hdiv[0] = 0;
+    for (int i = 1; i < 256; i++) {
+      sdiv[i] = cvRound((255 << hsvShift) / (1.*i));
+      hdiv[i] = cvRound((180 << hsvShift) / (6.*i));
+    }
+  }
+};
+
+static const hsvTables& tables() {
+  static const hsvTables t;
+  return t;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// the six bounds, as inclusive integer ranges
+struct hsvBounds {
+  int hueLo, hueHi;
+  bool hueWrap;
+  int satLo, satHi;
+  int valLo, valHi;
+};
+
+static struct hsvBounds compileBounds(const struct thresholdSettings& s) {
+  struct hsvBounds b;
+  b.hueLo = s.hueMin;
+  b.hueHi = s.hueMax;
+  b.hueWrap = !(s.hueMin < s.hueMax);
+  b.satLo = s.satMin;
+  b.satHi = s.satMax;
+  b.valLo = s.valMin;
+  b.valHi = s.valMax;
+  return b;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+static inline void pixelHsv(int b, int g, int r, const hsvTables& t, int& h, int& s, int& v) {
+  v = std::max(b, std::max(g, r));
+  int vmin = std::min(b, std::min(g, r));
+  int diff = v - vmin;
+
+  s = (diff * t.sdiv[v] + (1 << (hsvShift-1))) >> hsvShift;
+
+  int num;
+  if (v == r) {
+    num = g - b;
+  }
+  else if (v == g) {
+    num = b - r + 2*diff;
+  }
+  else {
+    num = r - g + 4*diff;
+  }
+  h = (num * t.hdiv[diff] + (1 << (hsvShift-1))) >> hsvShift;
+  if (h < 0) {
+    h += 180;
+  }
+}
+
+static inline uchar inBounds(int h, int s, int v, const struct hsvBounds& k) {
+  bool hueOk = k.hueWrap ?
+    (h >= k.hueLo || h <= k.hueHi) :
+    (h >= k.hueLo && h <= k.hueHi);
+  bool ok = hueOk &&
+    s >= k.satLo && s <= k.satHi &&
+    v >= k.valLo && v <= k.valHi;
+  return ok ? 255 : 0;
+}
+
+// pixels [start, width) of a row; bgr and masks point at pixel 0
+static void thresholdRowScalar(const uchar* bgr, uchar* const* masks, int start, int width,
+                               const struct hsvBounds* k, int count) {
+  const hsvTables& t = tables();
+  bgr += 3*start;
+  for (int x = start; x < width; x++, bgr += 3) {
+    int h, s, v;
+    pixelHsv(bgr[0], bgr[1], bgr[2], t, h, s, v);
+    for (int i = 0; i < count; i++) {
+      masks[i][x] = inBounds(h, s, v, k[i]);
+    }
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+/* Thin per-ISA wrappers, so the classification below is written once. Comparison
+ * results are all-ones/all-zero lanes kept in the float or int vector type.
+ */
+
+#if defined(SMM_HSV_AVX2)
+
+typedef __m256  vfloat;
+typedef __m256i vint;
+
+static inline vfloat fSet(float x)                     { return _mm256_set1_ps(x); }
+static inline vfloat fAdd(vfloat a, vfloat b)          { return _mm256_add_ps(a, b); }
+static inline vfloat fSub(vfloat a, vfloat b)          { return _mm256_sub_ps(a, b); }
+static inline vfloat fMul(vfloat a, vfloat b)          { return _mm256_mul_ps(a, b); }
+static inline vfloat fDiv(vfloat a, vfloat b)          { return _mm256_div_ps(a, b); }
+static inline vfloat fMax(vfloat a, vfloat b)          { return _mm256_max_ps(a, b); }
+static inline vfloat fMin(vfloat a, vfloat b)          { return _mm256_min_ps(a, b); }
+static inline vfloat fEq(vfloat a, vfloat b)           { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+static inline vfloat fGt(vfloat a, vfloat b)           { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+static inline vfloat fAnd(vfloat m, vfloat a)          { return _mm256_and_ps(m, a); }
+static inline vfloat fSelect(vfloat m, vfloat a, vfloat b) { return _mm256_blendv_ps(b, a, m); }
+static inline vint   fRound(vfloat a)                  { return _mm256_cvtps_epi32(a); }
+static inline vfloat fFromInt(vint a)                  { return _mm256_cvtepi32_ps(a); }
+
+static inline vint iSet(int x)                         { return _mm256_set1_epi32(x); }
+static inline vint iAdd(vint a, vint b)                { return _mm256_add_epi32(a, b); }
+static inline vint iShift(vint a)                      { return _mm256_srai_epi32(a, hsvShift); }
+static inline vint iGt(vint a, vint b)                 { return _mm256_cmpgt_epi32(a, b); }
+static inline vint iAnd(vint a, vint b)                { return _mm256_and_si256(a, b); }
+static inline vint iOr(vint a, vint b)                 { return _mm256_or_si256(a, b); }
+static inline vint iAndNot(vint m, vint a)             { return _mm256_andnot_si256(m, a); }
+
+#elif defined(SMM_HSV_SSE2)
+
+typedef __m128  vfloat;
+typedef __m128i vint;
+
+static inline vfloat fSet(float x)                     { return _mm_set1_ps(x); }
+static inline vfloat fAdd(vfloat a, vfloat b)          { return _mm_add_ps(a, b); }
+static inline vfloat fSub(vfloat a, vfloat b)          { return _mm_sub_ps(a, b); }
+static inline vfloat fMul(vfloat a, vfloat b)          { return _mm_mul_ps(a, b); }
+static inline vfloat fDiv(vfloat a, vfloat b)          { return _mm_div_ps(a, b); }
+static inline vfloat fMax(vfloat a, vfloat b)          { return _mm_max_ps(a, b); }
+static inline vfloat fMin(vfloat a, vfloat b)          { return _mm_min_ps(a, b); }
+static inline vfloat fEq(vfloat a, vfloat b)           { return _mm_cmpeq_ps(a, b); }
+static inline vfloat fGt(vfloat a, vfloat b)           { return _mm_cmpgt_ps(a, b); }
+static inline vfloat fAnd(vfloat m, vfloat a)          { return _mm_and_ps(m, a); }
+static inline vfloat fSelect(vfloat m, vfloat a, vfloat b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+static inline vint   fRound(vfloat a)                  { return _mm_cvtps_epi32(a); }
+static inline vfloat fFromInt(vint a)                  { return _mm_cvtepi32_ps(a); }
+
+static inline vint iSet(int x)                         { return _mm_set1_epi32(x); }
+static inline vint iAdd(vint a, vint b)                { return _mm_add_epi32(a, b); }
+static inline vint iShift(vint a)                      { return _mm_srai_epi32(a, hsvShift); }
+static inline vint iGt(vint a, vint b)                 { return _mm_cmpgt_epi32(a, b); }
+static inline vint iAnd(vint a, vint b)                { return _mm_and_si128(a, b); }
+static inline vint iOr(vint a, vint b)                 { return _mm_or_si128(a, b); }
+static inline vint iAndNot(vint m, vint a)             { return _mm_andnot_si128(m, a); }
+
+#elif defined(SMM_HSV_NEON)
+
+typedef float32x4_t vfloat;
+typedef int32x4_t   vint;
+
+static inline vfloat fSet(float x)                     { return vdupq_n_f32(x); }
+static inline vfloat fAdd(vfloat a, vfloat b)          { return vaddq_f32(a, b); }
+static inline vfloat fSub(vfloat a, vfloat b)          { return vsubq_f32(a, b); }
+static inline vfloat fMul(vfloat a, vfloat b)          { return vmulq_f32(a, b); }
+static inline vfloat fDiv(vfloat a, vfloat b)          { return vdivq_f32(a, b); }
+static inline vfloat fMax(vfloat a, vfloat b)          { return vmaxq_f32(a, b); }
+static inline vfloat fMin(vfloat a, vfloat b)          { return vminq_f32(a, b); }
+static inline vfloat fEq(vfloat a, vfloat b)           { return vreinterpretq_f32_u32(vceqq_f32(a, b)); }
+static inline vfloat fGt(vfloat a, vfloat b)           { return vreinterpretq_f32_u32(vcgtq_f32(a, b)); }
+static inline vfloat fAnd(vfloat m, vfloat a)          { return vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(m), vreinterpretq_u32_f32(a))); }
+static inline vfloat fSelect(vfloat m, vfloat a, vfloat b) { return vbslq_f32(vreinterpretq_u32_f32(m), a, b); }
+static inline vint   fRound(vfloat a)                  { return vcvtnq_s32_f32(a); }
+static inline vfloat fFromInt(vint a)                  { return vcvtq_f32_s32(a); }
+
+static inline vint iSet(int x)                         { return vdupq_n_s32(x); }
+static inline vint iAdd(vint a, vint b)                { return vaddq_s32(a, b); }
+static inline vint iShift(vint a)                      { return vshrq_n_s32(a, hsvShift); }
+static inline vint iGt(vint a, vint b)                 { return vreinterpretq_s32_u32(vcgtq_s32(a, b)); }
+static inline vint iAnd(vint a, vint b)                { return vandq_s32(a, b); }
+static inline vint iOr(vint a, vint b)                 { return vorrq_s32(a, b); }
+static inline vint iAndNot(vint m, vint a)             { return vbicq_s32(a, m); }
+
+#endif
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#if defined(SMM_HSV_AVX2) || defined(SMM_HSV_SSE2) || defined(SMM_HSV_NEON)
+
+// the bounds broadcast to every lane, as exclusive-below/inclusive-above pairs
+struct laneBounds {
+  vint hueLo, hueHi;
+  vint hueWrap;
+  vint satLo, satHi;
+  vint valLo, valHi;
+};
+
+static struct laneBounds broadcastBounds(const struct hsvBounds& k) {
+  struct laneBounds l;
+  l.hueLo   = iSet(k.hueLo - 1);
+  l.hueHi   = iSet(k.hueHi);
+  l.hueWrap = iSet(k.hueWrap ? -1 : 0);
+  l.satLo   = iSet(k.satLo - 1);
+  l.satHi   = iSet(k.satHi);
+  l.valLo   = iSet(k.valLo - 1);
+  l.valHi   = iSet(k.valHi);
+  return l;
+}
+
+// lo < x <= hi
+static inline vint inRange(vint x, vint lo, vint hi) {
+  return iAndNot(iGt(x, hi), iGt(x, lo));
+}
+
+// round(n/d) from a correctly rounded float quotient. The quotient can be off by
+// one near a .5 boundary; the exact residual n - r*d puts it right. True ties are
+// representable in float, so the round-half-even conversion already gets those.
+static inline vfloat roundedQuotient(vfloat n, vfloat d) {
+  vfloat one = fSet(1.0f);
+  vfloat r = fFromInt(fRound(fDiv(n, d)));
+  vfloat e2 = fMul(fSub(n, fMul(r, d)), fSet(2.0f));
+  r = fAdd(r, fAnd(fGt(e2, d), one));
+  return fSub(r, fAnd(fGt(fSub(fSet(0.0f), d), e2), one));
+}
+
+// converts lanes of B, G and R to OpenCV's H, S and V
+static inline void hsvLanes(vfloat b, vfloat g, vfloat r, vint& h, vint& s, vint& v) {
+  vfloat one = fSet(1.0f);
+
+  vfloat vf   = fMax(b, fMax(g, r));
+  vfloat diff = fSub(vf, fMin(b, fMin(g, r)));
+
+  // hue numerator; red takes priority over green, as in OpenCV
+  vfloat num = fSelect(fEq(vf, g),
+                       fAdd(fSub(b, r), fMul(diff, fSet(2.0f))),
+                       fAdd(fSub(r, g), fMul(diff, fSet(4.0f))));
+  num = fSelect(fEq(vf, r), fSub(g, b), num);
+
+  // a zero divisor only happens when the matching product is zero anyway
+  vfloat sdiv = roundedQuotient(fSet((float) sdivNumerator), fMax(vf, one));
+  vfloat hdiv = roundedQuotient(fSet((float) hdivNumerator), fMax(diff, one));
+
+  vint half = iSet(1 << (hsvShift-1));
+  s = iShift(iAdd(fRound(fMul(diff, sdiv)), half));
+  h = iShift(iAdd(fRound(fMul(num, hdiv)), half));
+  h = iAdd(h, iAnd(iGt(iSet(0), h), iSet(180)));
+  v = fRound(vf);
+}
+
+static inline vint inBoundsLanes(vint h, vint s, vint v, const struct laneBounds& k) {
+  vint above = iGt(h, k.hueLo);
+  vint below = iAndNot(iGt(h, k.hueHi), iSet(-1));
+  vint hueOk = iOr(iAnd(k.hueWrap, iOr(above, below)),
+                   iAndNot(k.hueWrap, iAnd(above, below)));
+
+  return iAnd(hueOk, iAnd(inRange(s, k.satLo, k.satHi),
+                          inRange(v, k.valLo, k.valHi)));
+}
+
+// H, S and V for one vector of pixels, shared by every profile
+struct hsvLaneSet {
+  vint h, s, v;
+};
+
+#endif
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#if defined(SMM_HSV_AVX2)
+
+// pick one channel of four packed BGR pixels and widen it to 32 bits
+static inline __m128i channel4(__m128i pixels, __m128i shuffle) {
+  return _mm_cvtepu8_epi32(_mm_shuffle_epi8(pixels, shuffle));
+}
+
+static inline vfloat channel8(__m128i lo, __m128i hi, __m128i shuffle) {
+  return _mm256_cvtepi32_ps(_mm256_inserti128_si256(_mm256_castsi128_si256(channel4(lo, shuffle)),
+                                                    channel4(hi, shuffle), 1));
+}
+
+// converts 8 pixels; reads 28 bytes starting at p
+static inline struct hsvLaneSet hsvAt8(const uchar* p) {
+  const __m128i shufB = _mm_setr_epi8(0, 3, 6,  9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+  const __m128i shufG = _mm_setr_epi8(1, 4, 7, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+  const __m128i shufR = _mm_setr_epi8(2, 5, 8, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+
+  __m128i lo = _mm_loadu_si128((const __m128i*) p);
+  __m128i hi = _mm_loadu_si128((const __m128i*) (p + 12));
+  struct hsvLaneSet l;
+  hsvLanes(channel8(lo, hi, shufB), channel8(lo, hi, shufG), channel8(lo, hi, shufR), l.h, l.s, l.v);
+  return l;
+}
+
+static void thresholdRowSimd(const uchar* bgr, uchar* const* masks, int width,
+                             const struct hsvBounds* bounds, int count) {
+  struct laneBounds k[hsvMaxProfiles];
+  for (int i = 0; i < count; i++) {
+    k[i] = broadcastBounds(bounds[i]);
+  }
+
+  // the second group reads 28 bytes from pixel x+8, so keep 2 pixels of slack
+  int x = 0;
+  for (; x + 18 <= width; x += 16, bgr += 48) {
+    struct hsvLaneSet p0 = hsvAt8(bgr);
+    struct hsvLaneSet p1 = hsvAt8(bgr + 24);
+    for (int i = 0; i < count; i++) {
+      __m256i m0 = inBoundsLanes(p0.h, p0.s, p0.v, k[i]);
+      __m256i m1 = inBoundsLanes(p1.h, p1.s, p1.v, k[i]);
+      __m256i packed16 = _mm256_permute4x64_epi64(_mm256_packs_epi32(m0, m1), 0xD8);
+      __m128i packed = _mm_packs_epi16(_mm256_castsi256_si128(packed16), _mm256_extracti128_si256(packed16, 1));
+      _mm_storeu_si128((__m128i*) (masks[i] + x), packed);
+    }
+  }
+  thresholdRowScalar(bgr - 3*x, masks, x, width, bounds, count);
+}
+
+#elif defined(SMM_HSV_SSE2)
+
+static inline struct hsvLaneSet hsvAt4(const uchar* p) {
+  vfloat b = _mm_cvtepi32_ps(_mm_setr_epi32(p[0], p[3], p[6], p[9]));
+  vfloat g = _mm_cvtepi32_ps(_mm_setr_epi32(p[1], p[4], p[7], p[10]));
+  vfloat r = _mm_cvtepi32_ps(_mm_setr_epi32(p[2], p[5], p[8], p[11]));
+  struct hsvLaneSet l;
+  hsvLanes(b, g, r, l.h, l.s, l.v);
+  return l;
+}
+
+static void thresholdRowSimd(const uchar* bgr, uchar* const* masks, int width,
+                             const struct hsvBounds* bounds, int count) {
+  struct laneBounds k[hsvMaxProfiles];
+  for (int i = 0; i < count; i++) {
+    k[i] = broadcastBounds(bounds[i]);
+  }
+
+  int x = 0;
+  for (; x + 16 <= width; x += 16, bgr += 48) {
+    struct hsvLaneSet p[4];
+    for (int j = 0; j < 4; j++) {
+      p[j] = hsvAt4(bgr + 12*j);
+    }
+    for (int i = 0; i < count; i++) {
+      __m128i m0 = inBoundsLanes(p[0].h, p[0].s, p[0].v, k[i]);
+      __m128i m1 = inBoundsLanes(p[1].h, p[1].s, p[1].v, k[i]);
+      __m128i m2 = inBoundsLanes(p[2].h, p[2].s, p[2].v, k[i]);
+      __m128i m3 = inBoundsLanes(p[3].h, p[3].s, p[3].v, k[i]);
+      __m128i packed = _mm_packs_epi16(_mm_packs_epi32(m0, m1), _mm_packs_epi32(m2, m3));
+      _mm_storeu_si128((__m128i*) (masks[i] + x), packed);
+    }
+  }
+  thresholdRowScalar(bgr - 3*x, masks, x, width, bounds, count);
+}
+
+#elif defined(SMM_HSV_NEON)
+
+static inline vfloat widenLow(uint16x8_t x)  { return vcvtq_f32_u32(vmovl_u16(vget_low_u16(x))); }
+static inline vfloat widenHigh(uint16x8_t x) { return vcvtq_f32_u32(vmovl_u16(vget_high_u16(x))); }
+
+static void thresholdRowSimd(const uchar* bgr, uchar* const* masks, int width,
+                             const struct hsvBounds* bounds, int count) {
+  struct laneBounds k[hsvMaxProfiles];
+  for (int i = 0; i < count; i++) {
+    k[i] = broadcastBounds(bounds[i]);
+  }
+
+  int x = 0;
+  for (; x + 8 <= width; x += 8, bgr += 24) {
+    uint8x8x3_t px = vld3_u8(bgr);
+    uint16x8_t b = vmovl_u8(px.val[0]);
+    uint16x8_t g = vmovl_u8(px.val[1]);
+    uint16x8_t r = vmovl_u8(px.val[2]);
+    struct hsvLaneSet lo, hi;
+    hsvLanes(widenLow(b),  widenLow(g),  widenLow(r),  lo.h, lo.s, lo.v);
+    hsvLanes(widenHigh(b), widenHigh(g), widenHigh(r), hi.h, hi.s, hi.v);
+    for (int i = 0; i < count; i++) {
+      vint m0 = inBoundsLanes(lo.h, lo.s, lo.v, k[i]);
+      vint m1 = inBoundsLanes(hi.h, hi.s, hi.v, k[i]);
+      uint16x8_t packed = vcombine_u16(vmovn_u32(vreinterpretq_u32_s32(m0)), vmovn_u32(vreinterpretq_u32_s32(m1)));
+      vst1_u8(masks[i] + x, vmovn_u16(packed));
+    }
+  }
+  thresholdRowScalar(bgr - 3*x, masks, x, width, bounds, count);
+}
+
+#endif
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void hsvThresholdRow(const uchar* bgr, uchar* mask, int width, const struct thresholdSettings& s) {
+  hsvThresholdRowMulti(bgr, &mask, width, &s, 1);
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void hsvThresholdRowMulti(const uchar* bgr, uchar* const* masks, int width,
+                          const struct thresholdSettings* s, int count) {
+  // more profiles than fit in registers are done in batches, converting once per batch
+  for (int first = 0; first < count; first += hsvMaxProfiles) {
+    int n = std::min(count - first, hsvMaxProfiles);
+    struct hsvBounds k[hsvMaxProfiles];
+    for (int i = 0; i < n; i++) {
+      k[i] = compileBounds(s[first + i]);
+    }
+#if defined(SMM_HSV_AVX2) || defined(SMM_HSV_SSE2) || defined(SMM_HSV_NEON)
+    thresholdRowSimd(bgr, masks + first, width, k, n);
+#else
+    thresholdRowScalar(bgr, masks + first, 0, width, k, n);
+#endif
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+static void thresholdImage(const cv::Mat& bgr, cv::Mat* masks, const struct thresholdSettings* s, int count) {
+  CV_Assert(bgr.type() == CV_8UC3);
+
+  bool continuous = bgr.isContinuous();
+  for (int i = 0; i < count; i++) {
+    masks[i].create(bgr.size(), CV_8UC1);
+    continuous = continuous && masks[i].isContinuous();
+  }
+
+  int rows = bgr.rows;
+  int width = bgr.cols;
+  if (continuous) {
+    width *= rows;
+    rows = 1;
+  }
+  std::vector<uchar*> rowPtrs(count);
+  for (int y = 0; y < rows; y++) {
+    for (int i = 0; i < count; i++) {
+      rowPtrs[i] = masks[i].ptr<uchar>(y);
+    }
+    hsvThresholdRowMulti(bgr.ptr<uchar>(y), rowPtrs.data(), width, s, count);
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void hsvThreshold(const cv::Mat& bgr, cv::Mat& mask, const struct thresholdSettings& s) {
+  thresholdImage(bgr, &mask, &s, 1);
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void hsvThresholdMulti(const cv::Mat& bgr, std::vector<cv::Mat>& masks,
+                       const std::vector<struct thresholdSettings>& s) {
+  masks.resize(s.size());
+  thresholdImage(bgr, masks.data(), s.data(), (int) s.size());
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void hsvThresholdReference(const cv::Mat& bgr, cv::Mat& mask, const struct thresholdSettings& s) {
+  std::vector<cv::Mat> chan;
+  cv::Mat hsv, mask_tmp;
+
+  cv::cvtColor(bgr, hsv, cv::COLOR_BGR2HSV);
+  cv::split(hsv,chan);
+  if (s.hueMin < s.hueMax) {
+    cv::threshold(chan[0],mask,s.hueMax, 255, cv::THRESH_BINARY_INV);
+    cv::threshold(chan[0],mask_tmp,s.hueMin-1, 255, cv::THRESH_BINARY);
+    cv::bitwise_and(mask_tmp,mask,mask);
+  }
+  else {
+    cv::threshold(chan[0],mask,s.hueMax, 255, cv::THRESH_BINARY_INV);
+    cv::threshold(chan[0],mask_tmp,s.hueMin-1, 255, cv::THRESH_BINARY);
+    cv::bitwise_or(mask_tmp,mask,mask);
+  }
+
+  cv::threshold(chan[1],mask_tmp,s.satMax, 255, cv::THRESH_BINARY_INV);
+  cv::bitwise_and(mask_tmp,mask,mask);
+  cv::threshold(chan[1],mask_tmp,s.satMin-1, 255, cv::THRESH_BINARY);
+  cv::bitwise_and(mask_tmp,mask,mask);
+
+  cv::threshold(chan[2],mask_tmp,s.valMax, 255, cv::THRESH_BINARY_INV);
+  cv::bitwise_and(mask_tmp,mask,mask);
+  cv::threshold(chan[2],mask_tmp,s.valMin-1, 255, cv::THRESH_BINARY);
+  cv::bitwise_and(mask_tmp,mask,mask);
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+const char* hsvThresholdIsa() {
+#if defined(SMM_HSV_AVX2)
+  return "AVX2";
+#elif defined(SMM_HSV_SSE2)
+  return "SSE2";
+#elif defined(SMM_HSV_NEON)
+  return "NEON";
+#else
+  return "scalar";
+#endif
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
@@ -0,0 +1,109 @@
+/*! @file
+ * Defines the HSV range threshold used to build the ball and background masks.
+ *
+ * hsvThreshold() is a fused kernel: it reads each BGR pixel once, converts it to HSV
+ * with OpenCV's integer arithmetic in registers, applies all six bounds and writes
+ * the mask byte directly. It produces exactly the same mask as
+ * hsvThresholdReference(), the original cvtColor/split/threshold chain.
+ * hsvThresholdMulti() does the same for several profiles, converting each pixel once.
+ */
+
+#ifndef SMM_HSV_THRESHOLD_HPP
+#define SMM_HSV_THRESHOLD_HPP
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+/*! @brief How a profile's erosions and dilations are applied. */
+enum morphologyMode {
+  /*! @brief One 3x3 pass per erosion or dilation; cheapest for small counts. */
+  morphologyIterated = 0,
+
+  /*! @brief A single square of side <tt>2n+1</tt>, at a cost nearly independent of @c n.
+   * The mask is the same as with morphologyIterated. */
+  morphologyBox = 1
+};
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+/*! @brief HSV bounds and cleanup settings for one mask profile.
+ *
+ * Hue is in OpenCV's 0-179 range. If @c hueMin is not less than @c hueMax the hue
+ * range wraps around, i.e. it selects <tt>hue >= hueMin || hue <= hueMax</tt>.
+ */
+struct thresholdSettings {
+  int hueMax;   
+  int satMax;   
+  int valMax;   
+  int hueMin;   
+  int satMin;   
+  int valMin;   
+  int erosions; 
+  int dilations;
+  int morphology; // a morphologyMode
+};
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+/*! @brief Threshold a row of BGR pixels against HSV bounds.
+ *
+ * @param bgr Pointer to @c width packed BGR pixels.
+ * @param mask Pointer to @c width output bytes, set to 255 inside the bounds and 0 outside.
+ * @param width Number of pixels in the row.
+ * @param s The bounds to apply. Erosions and dilations are ignored.
+ */
+void hsvThresholdRow(const uchar* bgr, uchar* mask, int width, const struct thresholdSettings& s);
+
+/*! @brief Threshold a row of BGR pixels against several sets of HSV bounds.
+ *
+ * Each pixel is converted to HSV once and tested against every set of bounds.
+ *
+ * @param bgr Pointer to @c width packed BGR pixels.
+ * @param masks Pointers to @c count output rows of @c width bytes each.
+ * @param width Number of pixels in the row.
+ * @param s Pointer to @c count sets of bounds; @c masks[i] gets @c s[i].
+ * @param count Number of profiles.
+ */
+void hsvThresholdRowMulti(const uchar* bgr, uchar* const* masks, int width,
+                          const struct thresholdSettings* s, int count);
+
+/*! @brief Threshold a BGR image against HSV bounds in a single pass.
+ *
+ * No erosion or dilation is applied.
+ *
+ * @param bgr The 8-bit, 3-channel BGR image.
+ * @param mask Receives the 8-bit mask. Its buffer is reused when the size matches.
+ * @param s The bounds to apply.
+ */
+void hsvThreshold(const cv::Mat& bgr, cv::Mat& mask, const struct thresholdSettings& s);
+
+/*! @brief Threshold a BGR image against several sets of HSV bounds in a single pass.
+ *
+ * No erosion or dilation is applied.
+ *
+ * @param bgr The 8-bit, 3-channel BGR image.
+ * @param masks Resized to one mask per profile. Existing buffers are reused when the size matches.
+ * @param s The bounds for each profile.
+ */
+void hsvThresholdMulti(const cv::Mat& bgr, std::vector<cv::Mat>& masks,
+                       const std::vector<struct thresholdSettings>& s);
+
+/*! @brief The original multi-pass threshold, kept to check hsvThreshold() against.
+ *
+ * Runs cvtColor, split and six threshold/bitwise pairs. No erosion or dilation is applied.
+ *
+ * @param bgr The 8-bit, 3-channel BGR image.
+ * @param mask Receives the 8-bit mask.
+ * @param s The bounds to apply.
+ */
+void hsvThresholdReference(const cv::Mat& bgr, cv::Mat& mask, const struct thresholdSettings& s);
+
+/*! @brief Name of the instruction set hsvThreshold() was compiled for. */
+const char* hsvThresholdIsa();
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#endif
@@ -1,6 +1,9 @@
 #include <iostream>
 #include <vector>
 #include <mutex>
+#include <thread>
+#include <cmath>
+#include <algorithm>
 
 #include <opencv2/core.hpp>
 #include <opencv2/imgproc.hpp>
@@ -8,6 +11,14 @@
 #include <opencv2/highgui.hpp>
 
 #include "smmServer.hpp"
+#include "frameSource.hpp"
+#include "pixelFormat.hpp"
+#include "capture.hpp"
+#include "hsvThreshold.hpp"
+#include "pipeline.hpp"
+#include "runMask.hpp"
+#include "encodedCache.hpp"
+#include "allocationCounter.hpp"
 
 extern "C" {
   #include "b64/base64.h"
@@ -15,33 +26,127 @@ extern "C" {
 
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
-struct thresholdSettings {
-  int hueMax;   
-  int satMax;   
-  int valMax;   
-  int hueMin;   
-  int satMin;   
-  int valMin;   
-  int erosions; 
-  int dilations;
-};
-
 struct glob {
   std::string settingsFile;
   std::mutex access;
-  cv::VideoCapture camera;
-  cv::Mat frame;
-  double imageScaling;
+  captureThread capture;
+  double imageScaling;   // masks and detection
+  double previewScaling; // the camera image sent to clients
+  double refineScaling;  // the window the ball is measured again in
+  int refineCandidates;  // coarse blobs measured again, largest first
+  int previewQuality;    // JPEG quality of the images sent to clients
+  std::string maskFormat; // how mask streams are encoded: "png", "rle" or "jpeg"
+  struct sourceSettings source;
+  struct sourceSettings fileSource; // source as loaded, without command-line overrides; what gets saved
+  std::string classifier; // "fused" or "lut"
+  std::string searchMode; // "full" or "roi"
+  double roiMargin;
+  int tiles;
+  int fileTiles; // tiles as loaded, without --tiles; what gets saved
+  unsigned long settingsVersion; // bumped on every settings change
+  struct detectionSettings detection;
+  struct trackerSettings tracking;
+  framePipeline pipeline;
+  encodedCache replies;
+  smmServer* server; // for pushing results to streams
   struct thresholdSettings ball;
   struct thresholdSettings bg;
 };
 
+// order of the profiles in pipelineSettings and frameResult
+enum maskProfile {
+  ballProfile = 0,
+  bgProfile = 1
+};
+
+// smallest camera image a client can ask for, as a power of two: 1/16 of the frame
+static const int maxThumbnailOctave = 4;
+
+// the MIME type of masks encoded as maskFormat says
+static const char* maskMimeType(const std::string& format) {
+  if (format == "png") {
+    return "image/png";
+  }
+  else if (format == "rle") {
+    return "application/octet-stream";
+  }
+  else {
+    return "image/jpeg";
+  }
+}
+
+// most erosions or dilations a profile can ask for; the tiled mask halo grows with them
+static const int maxMorphologyPasses = 32;
+
+// whether a profile's erosion and dilation counts are in [0, maxMorphologyPasses]
+static bool validMorphologyPasses(const struct thresholdSettings& s) {
+  return s.erosions >= 0 && s.erosions <= maxMorphologyPasses &&
+         s.dilations >= 0 && s.dilations <= maxMorphologyPasses;
+}
+
+// whether a tile count is in [1, number of hardware threads]; each tile gets a thread
+static bool validTiles(int tiles) {
+  int threads = std::max(1, (int) std::thread::hardware_concurrency());
+  return tiles >= 1 && tiles <= threads;
+}
+
+// furthest ahead, in milliseconds, a client can ask the ball to be predicted
+static const double maxPredictionAhead = 2000;
+
+
+// command-line overrides; empty strings and negative numbers mean "not given"
+struct commandLine {
+  std::string settingsFile;
+  std::string sourceType;
+  int camera;
+  std::string path;
+  int width;
+  int height;
+  double fps;
+  int fast;
+  std::string format;
+  std::string trajectory;
+  int benchmarkFrames;
+  bool sweep;
+  int tiles;
+};
 
-void sendMat(cv::Mat& frame, httpMessage& m);
+bool parseCommandLine(int argc, char** argv, struct commandLine* cl);
+void applyCommandLine(struct commandLine* cl, struct sourceSettings* s);
+void printUsage(const char* name);
+int runBenchmark(struct glob* g, int frames);
+
+void currentPipelineSettings(struct pipelineSettings& s, void* data);
+std::shared_ptr<const struct frameResult> latestResult(struct glob* g);
+
+void encodeBase64(const unsigned char* raw, size_t size, std::string& encoded);
+void encodeMat(const cv::Mat& mat, std::string& encoded, bool base64, int quality);
+void encodeRuns(const bitMask& mask, std::string& encoded, bool base64);
+void encodePng(const bitMask& mask, std::string& encoded);
+std::shared_ptr<const std::string> encodedImage(struct glob* g, const struct frameResult& result,
+                                                const std::string& output, const cv::Mat& mat,
+                                                bool base64, int quality);
+std::shared_ptr<const std::string> encodedMask(struct glob* g, const struct frameResult& result,
+                                               const std::string& output, const bitMask& mask,
+                                               bool base64, int quality);
+std::shared_ptr<const std::string> encodedLossless(struct glob* g, const struct frameResult& result,
+                                                   const std::string& output, const bitMask& mask,
+                                                   const std::string& format, bool base64);
+void sendResult(struct glob* g, httpMessage& m, const struct frameResult& result,
+                const std::string& output, const cv::Mat& mat);
+void sendResult(struct glob* g, httpMessage& m, const struct frameResult& result,
+                const std::string& output, const bitMask& mask);
 void serveCameraImage(httpMessage message, void* data);
-cv::Mat getMask(cv::Mat& frame, struct thresholdSettings s);
 void serveBallMask(httpMessage message, void* data);
 void serveBgMask(httpMessage message, void* data);
+void serveBallState(httpMessage message, void* data);
+void ballStateJson(struct glob* g, const struct frameResult& result, double ahead, std::string& buffer);
+void serveStats(httpMessage message, void* data);
+std::shared_ptr<const std::string> streamCameraImage(unsigned long& id, void* data);
+std::shared_ptr<const std::string> streamBallMask(unsigned long& id, void* data);
+std::shared_ptr<const std::string> streamBgMask(unsigned long& id, void* data);
+std::shared_ptr<const std::string> streamBallState(unsigned long& id, void* data);
+void publishResult(std::shared_ptr<const struct frameResult> result, void* data);
 
 void serveBallSettings(httpMessage message, void* data);
 void setBallSettings(httpMessage message, void* data);
@@ -55,31 +160,96 @@ void saveSettings(httpMessage message, void* data);
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
 int main(int argc, char** argv) {
+  struct commandLine cl;
+  if (!parseCommandLine(argc, argv, &cl)) {
+    printUsage(argv[0]);
+    return 2;
+  }
+
   // important variables
   struct glob g;
   g.imageScaling = 0.25; // image quality
-  g.settingsFile = "settings.yaml"; // mask settings
+  g.previewScaling = 0.25;
+  g.refineScaling = 1;
+  g.refineCandidates = 1;
+  g.previewQuality = 95;
+  g.maskFormat = "png";
+  g.settingsFile = cl.settingsFile; // mask settings
+  g.server = NULL;
+  g.classifier = "fused";
+  g.searchMode = "full";
+  g.roiMargin = 3;
+  g.tiles = 1;
+  g.ball.morphology = morphologyIterated;
+  g.bg.morphology = morphologyIterated;
+  g.settingsVersion = 1;
+  g.detection.excludeBackground = 0;
+  g.detection.minArea = 20;
+  g.detection.method = "blobs";
+  g.tracking.processNoise = 1e5;
+  g.tracking.measurementNoise = 2;
+  g.tracking.latency = 30;
+  g.tracking.lostTimeout = 500;
+  defaultSourceSettings(&g.source);
 
   if (!loadSettings(&g)) {
     std::cerr << "FATAL: could not load settings file '" << g.settingsFile << "'; aborting!" << std::endl;
     return 2;
   }
 
-  // open camera
-  g.camera = cv::VideoCapture(1);
-  if (!g.camera.isOpened()) {
-    std::cerr << "FATAL: could not open camera!" << std::endl;
+  // command-line source selection overrides the settings file, but only for this
+  // run: saving writes back what was loaded
+  g.fileSource = g.source;
+  g.fileTiles = g.tiles;
+  applyCommandLine(&cl, &g.source);
+  if (cl.tiles > 0) {
+    g.tiles = cl.tiles;
+  }
+
+  if (cl.benchmarkFrames > 0 && cl.sweep) {
+    if (g.source.type != "synthetic") {
+      std::cerr << "FATAL: --sweep needs the synthetic source" << std::endl;
+      return 2;
+    }
+    // 320p through 4K
+    const cv::Size sizes[] = { cv::Size(320, 240), cv::Size(640, 480), cv::Size(1280, 720),
+                               cv::Size(1920, 1080), cv::Size(3840, 2160) };
+    for (const cv::Size& size : sizes) {
+      g.source.width  = size.width;
+      g.source.height = size.height;
+      if (runBenchmark(&g, cl.benchmarkFrames) != 0) {
+        return 1;
+      }
+    }
+    return 0;
+  }
+  if (cl.benchmarkFrames > 0) {
+    return runBenchmark(&g, cl.benchmarkFrames);
+  }
+
+  // open frame source
+  if (!g.capture.open(g.source)) {
+    std::cerr << "FATAL: could not open frame source!" << std::endl;
     return 1;
   }
+  g.capture.launch();
 
   std::string httpPort = "8000";
   std::string rootPath = "./web_root";
 
   smmServer server(httpPort, rootPath, &g);
+  g.server = &server;
   
   server.addGetCallback("cameraImage",  &serveCameraImage );
   server.addGetCallback("ballMask", &serveBallMask);
   server.addGetCallback("bgMask", &serveBgMask);
+  server.addGetCallback("ballState", &serveBallState);
+  server.addGetCallback("stats", &serveStats);
+
+  server.addStreamCallback("cameraImage", "image/jpeg", &streamCameraImage);
+  server.addStreamCallback("ballMask", maskMimeType(g.maskFormat), &streamBallMask);
+  server.addStreamCallback("bgMask", maskMimeType(g.maskFormat), &streamBgMask);
+  server.addStreamCallback("ballState", "application/json", &streamBallState);
 
   server.addGetCallback("ballSettings", &serveBallSettings);
   server.addPostCallback("setBallSettings", &setBallSettings);
@@ -91,125 +261,1359 @@ int main(int argc, char** argv) {
   
   server.launch();
 
+  // detect the ball in every frame, not just the ones the browser asks for, and push
+  // each result to the streams
+  g.pipeline.launch(&g.capture, &currentPipelineSettings, &g, &publishResult);
+
   std::cout << "Server started on port " << httpPort << std::endl;
   
   while(server.isRunning()) {}
 
+  g.pipeline.shutdown();
+  g.capture.shutdown();
   return 0;
 }
 
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
+bool parseCommandLine(int argc, char** argv, struct commandLine* cl) {
+  cl->settingsFile = "settings.yaml";
+  cl->sourceType = "";
+  cl->camera = -1;
+  cl->path = "";
+  cl->width = -1;
+  cl->height = -1;
+  cl->fps = -1;
+  cl->fast = -1;
+  cl->format = "";
+  cl->trajectory = "";
+  cl->benchmarkFrames = 0;
+  cl->sweep = false;
+  cl->tiles = -1;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    bool hasValue = i+1 < argc;
+
+    try {
+      if (arg == "--settings" && hasValue) {
+        cl->settingsFile = argv[++i];
+      }
+      else if (arg == "--camera" && hasValue) {
+        cl->sourceType = "camera";
+        cl->camera = std::stoi(argv[++i]);
+      }
+      else if (arg == "--video" && hasValue) {
+        cl->sourceType = "video";
+        cl->path = argv[++i];
+      }
+      else if (arg == "--images" && hasValue) {
+        cl->sourceType = "images";
+        cl->path = argv[++i];
+      }
+      else if (arg == "--synthetic") {
+        cl->sourceType = "synthetic";
+      }
+      else if (arg == "--size" && hasValue) {
+        std::string size = argv[++i];
+        size_t x = size.find('x');
+        if (x == std::string::npos) {
+          return false;
+        }
+        cl->width  = std::stoi(size.substr(0, x));
+        cl->height = std::stoi(size.substr(x+1));
+      }
+      else if (arg == "--fps" && hasValue) {
+        cl->fps = std::stod(argv[++i]);
+      }
+      else if (arg == "--fast") {
+        cl->fast = 1;
+      }
+      else if (arg == "--format" && hasValue) {
+        cl->format = argv[++i];
+      }
+      else if (arg == "--trajectory" && hasValue) {
+        cl->trajectory = argv[++i];
+      }
+      else if (arg == "--benchmark" && hasValue) {
+        cl->benchmarkFrames = std::stoi(argv[++i]);
+      }
+      else if (arg == "--sweep") {
+        cl->sweep = true;
+      }
+      else if (arg == "--tiles" && hasValue) {
+        cl->tiles = std::stoi(argv[++i]);
+        if (!validTiles(cl->tiles)) {
+          std::cerr << "error: --tiles must be between 1 and the number of hardware threads ("
+                    << std::thread::hardware_concurrency() << ")" << std::endl;
+          return false;
+        }
+      }
+      else {
+        std::cerr << "error: unrecognized argument '" << arg << "'" << std::endl;
+        return false;
+      }
+    }
+    catch (std::invalid_argument error) {
+      std::cerr << "error: invalid value for '" << arg << "'" << std::endl;
+      return false;
+    }
+    catch (std::out_of_range error) {
+      std::cerr << "error: invalid value for '" << arg << "'" << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
 
-void sendMat(cv::Mat& mat, httpMessage& m) {
-  // get raw JPEG bytes from frame
-  std::vector<unsigned char> rawJpegBuffer;
-  cv::imencode(".jpeg", mat, rawJpegBuffer);
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
-  // convert to base64
-  unsigned int bufferSize = b64e_size(rawJpegBuffer.size())+1;
-  unsigned char* b64JpegBuffer = (unsigned char*) malloc(bufferSize * sizeof(unsigned char));
-  b64_encode(rawJpegBuffer.data(), rawJpegBuffer.size(), b64JpegBuffer);
-  
-  m.replyHttpContent("image/jpeg", std::string((char*) b64JpegBuffer, bufferSize));
-  free(b64JpegBuffer);
+void applyCommandLine(struct commandLine* cl, struct sourceSettings* s) {
+  if (cl->sourceType != "") {
+    s->type = cl->sourceType;
+  }
+  if (cl->camera >= 0) {
+    s->camera = cl->camera;
+  }
+  if (cl->path != "") {
+    s->path = cl->path;
+  }
+  if (cl->width > 0 && cl->height > 0) {
+    s->width  = cl->width;
+    s->height = cl->height;
+  }
+  if (cl->fps > 0) {
+    s->fps = cl->fps;
+  }
+  if (cl->fast >= 0) {
+    s->fast = cl->fast;
+  }
+  if (cl->format != "") {
+    s->format = cl->format;
+  }
+  if (cl->trajectory != "") {
+    s->scene.trajectory = cl->trajectory;
+  }
 }
-  
 
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
-void serveCameraImage(httpMessage message,
-                      void* data) {
+void printUsage(const char* name) {
+  std::cerr << "usage: " << name << " [options]\n"
+            << "  --settings FILE   settings file (default: settings.yaml)\n"
+            << "  --camera N        capture from camera N\n"
+            << "  --video FILE      play a video file\n"
+            << "  --images DIR      play a directory (or glob pattern) of images\n"
+            << "  --synthetic       render a synthetic scene\n"
+            << "  --size WxH        synthetic frame size\n"
+            << "  --trajectory NAME synthetic ball path: circle, figure8, bounce or waypoints\n"
+            << "  --fps N           playback rate for recorded and synthetic sources\n"
+            << "  --fast            play recorded and synthetic sources as fast as possible\n"
+            << "  --format NAME     camera and synthetic pixel format: bgr, yuyv or nv12\n"
+            << "  --benchmark N     time the vision pipeline over N frames and exit\n"
+            << "  --sweep           with --benchmark, repeat at synthetic sizes from 320p to 4K\n"
+            << "  --tiles N         compute masks in N tiles on N threads\n";
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// The benchmark's stages. Each keeps its figures in a struct of its own, adds a frame
+// to them in its bench function and prints its lines in its report function.
+
+// several viewers of the preview through the shared encode cache, against each
+// viewer encoding its own
+static const int fanOutViewers = 4;
+
+// a large square applied as repeated 3x3 passes and as one box
+static const int largeRadius = 10;
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// the measured pipeline, its ROI search and tracker, and its accuracy
+struct pipelineBench {
+  int64 ticks;
+
+  // how much of each frame the ROI search actually looked at
+  int windowedFrames;
+  double processedSum;
+
+  // centroid accuracy against ground truth, for sources that have it
+  int truthFrames, misses;
+  double errorSum, errorMax;
+
+  // frames are stamped at their nominal exposure time plus the configured latency, so
+  // the tracker's one-frame-ahead prediction can be compared with the truth
+  int predictedFrames;
+  double predictedErrorSum, staleErrorSum;
+  struct ballState previous;
+
+  // in a counting build the frames also go through a pipeline in the search mode the
+  // settings don't use, so both modes' steady state is checked for allocations
+  framePipeline otherModePipeline;
+  struct pipelineSettings otherModeSettings;
+
+  pipelineBench() : ticks(0), windowedFrames(0), processedSum(0), truthFrames(0), misses(0), errorSum(0),
+                    errorMax(0), predictedFrames(0), predictedErrorSum(0), staleErrorSum(0) {}
+};
+
+static void preparePipelineBench(struct pipelineBench* b, struct glob* g, const struct pipelineSettings& settings,
+                                 int format) {
+  // build the tables up front so every frame goes through them
+  if (settings.classifier == "lut") {
+    int64 t0 = cv::getTickCount();
+    g->pipeline.prepare(settings, format);
+    std::cout << "built lookup tables in "
+              << (cv::getTickCount() - t0) * 1000.0 / cv::getTickFrequency() << " ms" << std::endl;
+  }
+  g->pipeline.resetTracker();
+
+  b->otherModeSettings = settings;
+  b->otherModeSettings.searchMode = settings.searchMode == "roi" ? "full" : "roi";
+  if (allocationCounting() && settings.classifier == "lut") {
+    b->otherModePipeline.prepare(b->otherModeSettings, format);
+  }
+}
+
+static std::shared_ptr<const struct frameResult> benchPipeline(struct pipelineBench* b, struct glob* g,
+                                                               const capturedFrame& frame,
+                                                               frameClock::time_point exposure,
+                                                               const struct pipelineSettings& settings) {
+  // where the tracker thinks the ball is, before it sees this frame
+  struct trackedBall predicted = g->pipeline.predictBall(exposure);
+  if (predicted.valid && b->previous.found && frame.hasTruth && frame.truth.visible) {
+    b->predictedFrames++;
+    b->predictedErrorSum += std::hypot(predicted.position.x - frame.truth.center.x,
+                                       predicted.position.y - frame.truth.center.y);
+    b->staleErrorSum += std::hypot(b->previous.center.x - frame.truth.center.x,
+                                   b->previous.center.y - frame.truth.center.y);
+  }
+
+  int64 t0 = cv::getTickCount();
+  std::shared_ptr<const struct frameResult> result = g->pipeline.process(frame, settings);
+  int64 t1 = cv::getTickCount();
+  b->ticks += t1 - t0;
+
+  if (allocationCounting()) {
+    b->otherModePipeline.process(frame, b->otherModeSettings);
+  }
+
+  b->previous = result->ball;
+  b->processedSum += result->processedFraction;
+  if (result->window.area() < result->maskSize.area()) {
+    b->windowedFrames++;
+  }
+
+  if (frame.hasTruth && frame.truth.visible) {
+    b->truthFrames++;
+    if (result->ball.found) {
+      double dx = result->ball.center.x - frame.truth.center.x;
+      double dy = result->ball.center.y - frame.truth.center.y;
+      double error = std::sqrt(dx*dx + dy*dy);
+      b->errorSum += error;
+      b->errorMax = std::max(b->errorMax, error);
+    }
+    else {
+      b->misses++;
+    }
+  }
+  return result;
+}
+
+static void reportPipeline(struct pipelineBench* b, struct glob* g, const struct pipelineSettings& settings,
+                           int n, double msPerTick) {
+  std::cout << "pipeline:      " << b->ticks * msPerTick << " ms/frame (resize, both masks, detection)\n"
+            << "search:        " << settings.searchMode << ", " << b->windowedFrames << "/" << n
+            << " frames windowed, " << 100 * b->processedSum / n << "% of pixels processed\n";
+  if (allocationCounting()) {
+    std::cout << "allocations:   " << g->pipeline.getStats().allocations << " in the last frame, "
+              << b->otherModePipeline.getStats().allocations << " in " << b->otherModeSettings.searchMode
+              << " mode\n";
+  }
+  else {
+    std::cout << "allocations:   not counted (configure with -DSMM_COUNT_ALLOCATIONS=ON)\n";
+  }
+  if (b->truthFrames > 0) {
+    int found = b->truthFrames - b->misses;
+    std::cout << "ball found:    " << found << "/" << b->truthFrames << " frames\n";
+    if (found > 0) {
+      std::cout << "centroid error: " << b->errorSum / found << " px mean, "
+                << b->errorMax << " px max (full resolution)\n";
+    }
+    if (b->predictedFrames > 0) {
+      std::cout << "next frame:    " << b->predictedErrorSum / b->predictedFrames << " px mean predicted, "
+                << b->staleErrorSum / b->predictedFrames << " px mean using the last detection\n";
+    }
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// refinement: the same frames searched at full resolution, how far the coarse
+// detection lies from the truth, and thumbnails from the result's pyramid
+struct refineBench {
+  // a pipeline of its own so its tracker and ROI don't disturb the one being measured;
+  // on recorded footage without ground truth, how far the two centroids lie apart
+  // stands in for the accuracy
+  framePipeline fullPipeline;
+  struct pipelineSettings fullSettings;
+  int64 fullTicks;
+  int agreeFrames;
+  double fullOffsetSum;
+
+  int refinedFrames;
+  int truthFrames, fullTruthFrames, coarseFrames;
+  double fullErrorSum, coarseErrorSum;
+
+  // a thumbnail shrunk from levels already made, against shrinking the BGR frame for it
+  cv::Mat directThumbnail;
+  int64 pyramidTicks, directThumbnailTicks;
+
+  refineBench() : fullTicks(0), agreeFrames(0), fullOffsetSum(0), refinedFrames(0), truthFrames(0),
+                  fullTruthFrames(0), coarseFrames(0), fullErrorSum(0), coarseErrorSum(0), pyramidTicks(0),
+                  directThumbnailTicks(0) {}
+};
+
+static void prepareRefineBench(struct refineBench* b, const struct pipelineSettings& settings, int format) {
+  b->fullSettings = settings;
+  b->fullSettings.imageScaling = 1;
+  b->fullSettings.refineCandidates = 1;
+  if (settings.classifier == "lut") {
+    b->fullPipeline.prepare(b->fullSettings, format);
+  }
+}
+
+static void benchRefine(struct refineBench* b, const capturedFrame& frame, const struct frameResult& result,
+                        const struct ballState& coarse, const cv::Mat& bgr) {
+  int64 t0 = cv::getTickCount();
+  std::shared_ptr<const struct frameResult> fullResult = b->fullPipeline.process(frame, b->fullSettings);
+  int64 t1 = cv::getTickCount();
+  b->fullTicks += t1 - t0;
+  if (fullResult->ball.found && result.ball.found) {
+    b->agreeFrames++;
+    b->fullOffsetSum += std::hypot(result.ball.center.x - fullResult->ball.center.x,
+                                   result.ball.center.y - fullResult->ball.center.y);
+  }
+
+  const double thumbnailScale = 0.125;
+  int64 t2 = cv::getTickCount();
+  result.pyramid.bgr(thumbnailScale);
+  int64 t3 = cv::getTickCount();
+  cv::resize(bgr, b->directThumbnail, cv::Size(), thumbnailScale, thumbnailScale, cv::INTER_AREA);
+  int64 t4 = cv::getTickCount();
+  b->pyramidTicks         += t3 - t2;
+  b->directThumbnailTicks += t4 - t3;
+
+  if (result.refined) {
+    b->refinedFrames++;
+  }
+  if (frame.hasTruth && frame.truth.visible) {
+    b->truthFrames++;
+    if (fullResult->ball.found) {
+      b->fullTruthFrames++;
+      b->fullErrorSum += std::hypot(fullResult->ball.center.x - frame.truth.center.x,
+                                    fullResult->ball.center.y - frame.truth.center.y);
+    }
+    if (coarse.found) {
+      b->coarseFrames++;
+      b->coarseErrorSum += std::hypot(coarse.center.x - frame.truth.center.x, coarse.center.y - frame.truth.center.y);
+    }
+  }
+}
+
+static void reportRefine(struct refineBench* b, const struct pipelineSettings& settings, int n,
+                         double msPerTick) {
+  std::cout << "refinement:    at scale " << settings.refineScaling << ", " << b->refinedFrames << "/" << n
+            << " frames refined, " << settings.refineCandidates << " candidates\n"
+            << "full res:      " << b->fullTicks * msPerTick << " ms/frame searching every pixel, "
+            << (b->agreeFrames > 0 ? b->fullOffsetSum / b->agreeFrames : 0) << " px mean from its centroid ("
+            << b->agreeFrames << " frames both found)\n"
+            << "pyramid:       " << b->pyramidTicks * msPerTick << " ms/frame for a 1/8 thumbnail from the cached levels, "
+            << b->directThumbnailTicks * msPerTick << " ms/frame from the BGR frame\n";
+  if (b->coarseFrames > 0) {
+    std::cout << "unrefined:     " << b->coarseErrorSum / b->coarseFrames << " px mean at the detection scale\n";
+  }
+  if (b->fullTruthFrames > 0) {
+    std::cout << "full res:      " << b->fullErrorSum / b->fullTruthFrames << " px mean, "
+              << b->fullTruthFrames << "/" << b->truthFrames << " frames found\n";
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// the detection stage on its own, against labeling byte masks and against the mask's
+// moments; it also runs inside the pipeline timing
+struct detectionBench {
+  int64 ticks, worst;
+  int64 labelTicks;
+  int labelDisagreements;
+  int64 momentTicks;
+  int momentFrames;
+  double momentOffsetSum;
+  cv::Mat ballWindow, bgWindow;
+
+  detectionBench() : ticks(0), worst(0), labelTicks(0), labelDisagreements(0), momentTicks(0), momentFrames(0),
+                     momentOffsetSum(0) {}
+};
+
+// returns the ball found at the detection scale, before refinement
+static struct ballState benchDetection(struct detectionBench* b, const struct frameResult& result,
+                                       const struct pipelineSettings& settings) {
+  const bitMask* exclude = NULL;
+  if (settings.excludeProfile >= 0) {
+    exclude = &result.masks[settings.excludeProfile];
+  }
+
+  int64 t0 = cv::getTickCount();
+  struct ballState fromRuns = detectBall(result.masks[ballProfile], exclude, result.window,
+                                         settings.imageScaling, settings.detection);
+  int64 t1 = cv::getTickCount();
+  b->ticks += t1 - t0;
+  b->worst = std::max(b->worst, t1 - t0);
+
+  // the byte-mask detector labels with connectedComponentsWithStats
+  result.masks[ballProfile].toMat(b->ballWindow, result.window);
+  if (exclude) {
+    exclude->toMat(b->bgWindow, result.window);
+  }
+  else {
+    b->bgWindow.release();
+  }
+  int64 t2 = cv::getTickCount();
+  struct ballState labeled = detectBall(b->ballWindow, b->bgWindow, settings.imageScaling, settings.detection);
+  int64 t3 = cv::getTickCount();
+  b->labelTicks += t3 - t2;
+  if (labeled.found != fromRuns.found ||
+      (labeled.found && std::hypot(labeled.center.x + result.window.x / settings.imageScaling - fromRuns.center.x,
+                                   labeled.center.y + result.window.y / settings.imageScaling - fromRuns.center.y) > 1e-3)) {
+    b->labelDisagreements++;
+  }
+
+  // the moments the mask stage sums with the "moments" method, timed on their own
+  int64 t4 = cv::getTickCount();
+  struct maskMoments moments;
+  const cv::Rect& w = result.window;
+  for (int y = w.y; y < w.y + w.height; y++) {
+    double count, sumX, sumXX;
+    result.masks[ballProfile].rowSums(y, w.x, w.x + w.width, exclude, count, sumX, sumXX);
+    moments.addRow(y, count, sumX, sumXX);
+  }
+  struct ballState fromMoments = detectBall(moments, settings.imageScaling, settings.detection);
+  int64 t5 = cv::getTickCount();
+  b->momentTicks += t5 - t4;
+  if (fromMoments.found && fromRuns.found) {
+    b->momentFrames++;
+    b->momentOffsetSum += std::hypot(fromMoments.center.x - fromRuns.center.x, fromMoments.center.y - fromRuns.center.y);
+  }
+  return fromRuns;
+}
+
+static void reportDetection(struct detectionBench* b, const struct pipelineSettings& settings, int n,
+                            double msPerTick) {
+  std::cout << "detection:     " << b->ticks * msPerTick << " ms/frame, "
+            << b->worst * msPerTick * n << " ms worst (runs), "
+            << b->labelTicks * msPerTick << " ms/frame with connectedComponentsWithStats, "
+            << b->labelDisagreements << " frames disagree\n"
+            << "moments:       " << b->momentTicks * msPerTick << " ms/frame to sum and use the mask's moments, "
+            << (b->momentFrames > 0 ? b->momentOffsetSum / b->momentFrames : 0) << " px mean offset from the largest blob"
+            << " (detection: " << settings.detection.method << ")\n";
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// encoding the preview and both masks, the shared encode cache, and the lossless mask
+// encodings against JPEG, each decoded again to check it
+struct encodeBench {
+  std::string encoded;
+  cv::Mat unpacked;
+  size_t encodedBytes;
+  int64 ticks;
+
+  int64 sharedTicks, ownTicks;
+
+  std::string rle, png;
+  size_t rleBytes, pngBytes, jpegMaskBytes;
+  int64 rleTicks, pngTicks, jpegMaskTicks;
+  long rleMismatches, pngMismatches;
+  runMask decodedRuns;
+  bitMask decodedMask;
+  cv::Mat decodedMat;
+
+  encodeBench() : encodedBytes(0), ticks(0), sharedTicks(0), ownTicks(0), rleBytes(0), pngBytes(0),
+                  jpegMaskBytes(0), rleTicks(0), pngTicks(0), jpegMaskTicks(0), rleMismatches(0),
+                  pngMismatches(0) {}
+};
+
+static void benchEncode(struct encodeBench* b, struct glob* g, const struct frameResult& result) {
+  int64 t0 = cv::getTickCount();
+  encodeMat(result.image, b->encoded, false, g->previewQuality);
+  b->encodedBytes += b->encoded.size();
+  result.masks[ballProfile].toMat(b->unpacked);
+  encodeMat(b->unpacked, b->encoded, false, g->previewQuality);
+  b->encodedBytes += b->encoded.size();
+  result.masks[bgProfile].toMat(b->unpacked);
+  encodeMat(b->unpacked, b->encoded, false, g->previewQuality);
+  b->encodedBytes += b->encoded.size();
+  int64 t1 = cv::getTickCount();
+  b->ticks += t1 - t0;
+
+  for (int i = 0; i < 2; i++) {
+    const bitMask& mask = result.masks[i];
+    int64 t2 = cv::getTickCount();
+    mask.toMat(b->unpacked);
+    encodeMat(b->unpacked, b->encoded, false, g->previewQuality);
+    int64 t3 = cv::getTickCount();
+    encodePng(mask, b->png);
+    int64 t4 = cv::getTickCount();
+    encodeRuns(mask, b->rle, false);
+    int64 t5 = cv::getTickCount();
+    b->jpegMaskTicks += t3 - t2;
+    b->pngTicks      += t4 - t3;
+    b->rleTicks      += t5 - t4;
+    b->jpegMaskBytes += b->encoded.size();
+    b->pngBytes      += b->png.size();
+    b->rleBytes      += b->rle.size();
+
+    b->decodedMat = cv::imdecode(cv::Mat(1, (int) b->png.size(), CV_8U, (void*) b->png.data()), cv::IMREAD_UNCHANGED);
+    if (b->decodedMat.size() == b->unpacked.size() && b->decodedMat.type() == b->unpacked.type()) {
+      b->pngMismatches += cv::countNonZero(b->decodedMat != b->unpacked);
+    }
+    else {
+      b->pngMismatches += (long) b->unpacked.total();
+    }
+    if (b->decodedRuns.deserialize(b->rle)) {
+      b->decodedRuns.toBitMask(b->decodedMask);
+      b->decodedMask.toMat(b->decodedMat);
+      b->rleMismatches += cv::countNonZero(b->decodedMat != b->unpacked);
+    }
+    else {
+      b->rleMismatches += (long) b->unpacked.total();
+    }
+  }
+
+  int64 t6 = cv::getTickCount();
+  for (int v = 0; v < fanOutViewers; v++) {
+    encodedImage(g, result, "cameraImage", result.image, false, g->previewQuality);
+  }
+  int64 t7 = cv::getTickCount();
+  for (int v = 0; v < fanOutViewers; v++) {
+    encodeMat(result.image, b->encoded, false, g->previewQuality);
+  }
+  int64 t8 = cv::getTickCount();
+  b->sharedTicks += t7 - t6;
+  b->ownTicks    += t8 - t7;
+}
+
+static void reportEncode(struct encodeBench* b, struct glob* g, int n, double msPerTick) {
+  std::cout << "encode x3:     " << b->ticks * msPerTick << " ms/frame ("
+            << b->encodedBytes / n << " bytes/frame, quality " << g->previewQuality << ")\n"
+            << "fan-out:       " << b->sharedTicks * msPerTick << " ms/frame for " << fanOutViewers
+            << " preview viewers sharing one encode, "
+            << b->ownTicks * msPerTick << " ms/frame encoding for each\n"
+            << "mask encoding: " << b->jpegMaskBytes / (2 * n) << " bytes, "
+            << b->jpegMaskTicks * msPerTick * 500 << " us per mask as JPEG; "
+            << b->pngBytes / (2 * n) << " bytes, " << b->pngTicks * msPerTick * 500 << " us as 1-bit PNG ("
+            << b->pngMismatches << " mismatched pixels); "
+            << b->rleBytes / (2 * n) << " bytes, " << b->rleTicks * msPerTick * 500 << " us as runs ("
+            << b->rleMismatches << " mismatched pixels)\n";
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// the threshold kernels: the fused kernel against the original multi-pass threshold,
+// and both profiles from one HSV conversion against one pass per profile
+struct thresholdBench {
+  cv::Mat fused, reference;
+  int64 fusedTicks, referenceTicks;
+  long mismatches;
+
+  std::vector<cv::Mat> shared;
+  cv::Mat separateBall, separateBg;
+  int64 sharedTicks, separateTicks;
+
+  thresholdBench() : fusedTicks(0), referenceTicks(0), mismatches(0), sharedTicks(0), separateTicks(0) {}
+};
+
+static void benchThreshold(struct thresholdBench* b, const cv::Mat& image, const struct pipelineSettings& settings) {
+  const struct thresholdSettings& ball = settings.profiles[ballProfile];
+  const struct thresholdSettings& bg = settings.profiles[bgProfile];
+
+  int64 t0 = cv::getTickCount();
+  hsvThreshold(image, b->fused, ball);
+  int64 t1 = cv::getTickCount();
+  hsvThresholdReference(image, b->reference, ball);
+  int64 t2 = cv::getTickCount();
+  b->fusedTicks     += t1 - t0;
+  b->referenceTicks += t2 - t1;
+  b->mismatches += cv::countNonZero(b->fused != b->reference);
+
+  int64 t3 = cv::getTickCount();
+  hsvThresholdMulti(image, b->shared, settings.profiles);
+  int64 t4 = cv::getTickCount();
+  hsvThreshold(image, b->separateBall, ball);
+  hsvThreshold(image, b->separateBg, bg);
+  int64 t5 = cv::getTickCount();
+  b->sharedTicks   += t4 - t3;
+  b->separateTicks += t5 - t4;
+}
+
+static void reportThreshold(struct thresholdBench* b, const struct pipelineSettings& settings,
+                            double msPerTick) {
+  std::cout << "classifier:    " << settings.classifier << "\n"
+            << "threshold:     " << b->fusedTicks * msPerTick << " ms/frame fused (" << hsvThresholdIsa() << "), "
+            << b->referenceTicks * msPerTick << " ms/frame multi-pass, "
+            << b->mismatches << " mismatched pixels\n"
+            << "both profiles: " << b->sharedTicks * msPerTick << " ms/frame shared HSV, "
+            << b->separateTicks * msPerTick << " ms/frame separately\n";
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// the mask stage in tiles against the same stage run serially, and, for YUV sources,
+// frames converted to BGR before scaling, as without the YUV path, against scaling the
+// planes and classifying YUV
+struct maskStageBench {
+  // these comparisons classify the frame in BGR, so they run on a pipeline of their
+  // own; on a YUV source a lookup table shared with the measured pipeline would be
+  // rebuilt for one format or the other on every frame
+  framePipeline bgrPipeline;
+  struct pipelineSettings serial;
+  std::vector<bitMask> tiledMasks, serialMasks;
+  int64 tiledTicks, serialTicks;
+  long tileMismatches;
+
+  int format;
+  cv::Mat converted, convertedScaled, yuvImage;
+  struct yuvScratch yuvPlanes;
+  std::vector<bitMask> convertedMasks, yuvMasks;
+  int64 convertedTicks, yuvTicks;
+  long yuvMismatches;
+
+  cv::Mat unpacked, serialMat;
+
+  maskStageBench() : tiledTicks(0), serialTicks(0), tileMismatches(0), format(pixelBgr), convertedTicks(0),
+                     yuvTicks(0), yuvMismatches(0) {}
+};
+
+static void prepareMaskStageBench(struct maskStageBench* b, const struct pipelineSettings& settings) {
+  if (settings.classifier == "lut") {
+    b->bgrPipeline.prepare(settings, pixelBgr);
+  }
+  b->serial = settings;
+  b->serial.tiles = 1;
+}
+
+static void benchMaskStage(struct maskStageBench* b, struct glob* g, const capturedFrame& frame,
+                           const cv::Mat& image, const struct pipelineSettings& settings) {
+  int64 t0 = cv::getTickCount();
+  b->bgrPipeline.maskImage(image, settings, b->tiledMasks);
+  int64 t1 = cv::getTickCount();
+  b->bgrPipeline.maskImage(image, b->serial, b->serialMasks);
+  int64 t2 = cv::getTickCount();
+  b->tiledTicks  += t1 - t0;
+  b->serialTicks += t2 - t1;
+  for (size_t i = 0; i < b->tiledMasks.size(); i++) {
+    if (!(b->tiledMasks[i] == b->serialMasks[i])) {
+      b->tiledMasks[i].toMat(b->unpacked);
+      b->serialMasks[i].toMat(b->serialMat);
+      b->tileMismatches += cv::countNonZero(b->unpacked != b->serialMat);
+    }
+  }
+
+  b->format = frame.format;
+  if (frame.format == pixelBgr) {
+    return;
+  }
+  int64 t3 = cv::getTickCount();
+  frameToBgr(frame.image, frame.format, b->converted);
+  cv::resize(b->converted, b->convertedScaled, cv::Size(), settings.imageScaling, settings.imageScaling, cv::INTER_AREA);
+  b->bgrPipeline.maskImage(b->convertedScaled, settings, b->convertedMasks);
+  int64 t4 = cv::getTickCount();
+  scaleYuv(frame.image, frame.format, settings.imageScaling, b->yuvImage, b->yuvPlanes);
+  g->pipeline.maskImage(b->yuvImage, settings, b->yuvMasks, true);
+  int64 t5 = cv::getTickCount();
+  b->convertedTicks += t4 - t3;
+  b->yuvTicks       += t5 - t4;
+  for (size_t i = 0; i < b->yuvMasks.size(); i++) {
+    if (b->convertedScaled.size() == b->yuvImage.size() && !(b->convertedMasks[i] == b->yuvMasks[i])) {
+      b->convertedMasks[i].toMat(b->unpacked);
+      b->yuvMasks[i].toMat(b->serialMat);
+      b->yuvMismatches += cv::countNonZero(b->unpacked != b->serialMat);
+    }
+  }
+}
+
+static void reportMaskStage(struct maskStageBench* b, const struct pipelineSettings& settings,
+                            double msPerTick) {
+  std::cout << "mask stage:    " << b->tiledTicks * msPerTick << " ms/frame in " << settings.tiles << " tiles, "
+            << b->serialTicks * msPerTick << " ms/frame serially, "
+            << b->tileMismatches << " mismatched pixels\n";
+  if (b->format != pixelBgr) {
+    std::cout << "yuv input:     " << b->convertedTicks * msPerTick << " ms/frame converting "
+              << pixelFormatName(b->format) << " to BGR first, "
+              << b->yuvTicks * msPerTick << " ms/frame classifying YUV, "
+              << b->yuvMismatches << " mismatched pixels (none expected without scaling)\n";
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// packed morphology and morphology on runs against cv::erode / cv::dilate on the same
+// thresholded masks, and a large square as repeated passes against one box
+struct morphologyBench {
+  std::vector<bitMask> packed;
+  std::vector<cv::Mat> cleaned;
+  int64 packedTicks, cvTicks;
+  long mismatches;
+
+  bitMask iterated, boxed;
+  int64 iteratedTicks, boxTicks;
+  long boxMismatches;
+
+  std::vector<runMask> runs;
+  bitMask fromRuns;
+  int64 runTicks;
+  long runMismatches;
+
+  cv::Mat unpacked, other;
+
+  morphologyBench() : packedTicks(0), cvTicks(0), mismatches(0), iteratedTicks(0), boxTicks(0), boxMismatches(0),
+                      runTicks(0), runMismatches(0) {}
+};
+
+static void benchMorphology(struct morphologyBench* b, const std::vector<cv::Mat>& masks,
+                            const struct pipelineSettings& settings) {
+  b->packed.resize(masks.size());
+  b->runs.resize(masks.size());
+  for (size_t i = 0; i < masks.size(); i++) {
+    b->packed[i] = bitMask::fromMat(masks[i]);
+    b->runs[i] = runMask::fromBitMask(b->packed[i], cv::Rect(0, 0, masks[i].cols, masks[i].rows));
+  }
+  int64 t0 = cv::getTickCount();
+  for (size_t i = 0; i < b->packed.size(); i++) {
+    b->packed[i].erode(settings.profiles[i].erosions);
+    b->packed[i].dilate(settings.profiles[i].dilations);
+  }
+  int64 t1 = cv::getTickCount();
+  b->cleaned.resize(masks.size());
+  for (size_t i = 0; i < masks.size(); i++) {
+    cv::erode(masks[i], b->cleaned[i], cv::Mat(), cv::Point(-1,-1), settings.profiles[i].erosions);
+    cv::dilate(b->cleaned[i], b->cleaned[i], cv::Mat(), cv::Point(-1,-1), settings.profiles[i].dilations);
+  }
+  int64 t2 = cv::getTickCount();
+  b->packedTicks += t1 - t0;
+  b->cvTicks     += t2 - t1;
+
+  for (size_t i = 0; i < masks.size(); i++) {
+    b->iterated = bitMask::fromMat(masks[i]);
+    b->boxed = b->iterated;
+    int64 t3 = cv::getTickCount();
+    b->iterated.erode(largeRadius);
+    b->iterated.dilate(largeRadius);
+    int64 t4 = cv::getTickCount();
+    b->boxed.erodeBox(largeRadius, largeRadius);
+    b->boxed.dilateBox(largeRadius, largeRadius);
+    int64 t5 = cv::getTickCount();
+    b->iteratedTicks += t4 - t3;
+    b->boxTicks      += t5 - t4;
+    if (!(b->iterated == b->boxed)) {
+      b->iterated.toMat(b->unpacked);
+      b->boxed.toMat(b->other);
+      b->boxMismatches += cv::countNonZero(b->unpacked != b->other);
+    }
+  }
+
+  int64 t6 = cv::getTickCount();
+  for (size_t i = 0; i < b->runs.size(); i++) {
+    b->runs[i].erode(settings.profiles[i].erosions);
+    b->runs[i].dilate(settings.profiles[i].dilations);
+  }
+  int64 t7 = cv::getTickCount();
+  b->runTicks += t7 - t6;
+
+  for (size_t i = 0; i < masks.size(); i++) {
+    b->packed[i].toMat(b->unpacked);
+    b->mismatches += cv::countNonZero(b->cleaned[i] != b->unpacked);
+    b->runs[i].toBitMask(b->fromRuns);
+    b->fromRuns.toMat(b->unpacked);
+    b->runMismatches += cv::countNonZero(b->cleaned[i] != b->unpacked);
+  }
+}
+
+static void reportMorphology(struct morphologyBench* b, double msPerTick) {
+  std::cout << "morphology:    " << b->packedTicks * msPerTick << " ms/frame packed, "
+            << b->cvTicks * msPerTick << " ms/frame with cv::erode/dilate, "
+            << b->mismatches << " mismatched pixels; "
+            << b->runTicks * msPerTick << " ms/frame on runs, "
+            << b->runMismatches << " mismatched pixels\n"
+            << "radius " << largeRadius << ":     " << b->iteratedTicks * msPerTick << " ms/frame iterated, "
+            << b->boxTicks * msPerTick << " ms/frame as one box, "
+            << b->boxMismatches << " mismatched pixels\n";
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+int runBenchmark(struct glob* g, int frames) {
+  std::unique_ptr<frameSource> source = openFrameSource(g->source);
+  if (!source) {
+    std::cerr << "FATAL: could not open frame source!" << std::endl;
+    return 1;
+  }
+  std::cout << "benchmarking " << frames << " frames from " << source->describe() << std::endl;
+
+  struct pipelineSettings settings;
+  currentPipelineSettings(settings, g);
+
+  struct pipelineBench pipeline;
+  struct refineBench refine;
+  struct detectionBench detection;
+  struct encodeBench encode;
+  struct thresholdBench threshold;
+  struct maskStageBench maskStage;
+  struct morphologyBench morphology;
+  preparePipelineBench(&pipeline, g, settings, source->format());
+  prepareRefineBench(&refine, settings, source->format());
+  prepareMaskStageBench(&maskStage, settings);
+
+  frameClock::duration period = std::chrono::duration_cast<frameClock::duration>(
+    std::chrono::duration<double>(1.0 / (source->fps() > 0 ? source->fps() : 30)));
+  frameClock::duration latency = std::chrono::duration_cast<frameClock::duration>(
+    std::chrono::duration<double, std::milli>(settings.tracking.latency));
+  frameClock::time_point start = frameClock::now();
+
+  // the kernels are compared on the frame in BGR at the detection scale
+  cv::Mat converted, convertedScaled;
+
+  capturedFrame frame;
+  std::shared_ptr<const struct frameResult> result;
+  int n;
+  for (n = 0; n < frames; n++) {
+    if (!source->read(frame.image)) {
+      break;
+    }
+    frame.format = source->format();
+    frame.id = n+1;
+    frame.timestamp = start + n*period + latency;
+    frame.hasTruth = source->groundTruth(&frame.truth);
+
+    result = benchPipeline(&pipeline, g, frame, start + n*period, settings);
+    benchEncode(&encode, g, *result);
+
+    frameToBgr(frame.image, frame.format, converted);
+    cv::resize(converted, convertedScaled, cv::Size(), settings.imageScaling, settings.imageScaling, cv::INTER_AREA);
+    benchThreshold(&threshold, convertedScaled, settings);
+    benchMorphology(&morphology, threshold.shared, settings);
+    benchMaskStage(&maskStage, g, frame, convertedScaled, settings);
+
+    struct ballState coarse = benchDetection(&detection, *result, settings);
+    benchRefine(&refine, frame, *result, coarse, converted);
+  }
+
+  if (n == 0) {
+    std::cerr << "error: source produced no frames" << std::endl;
+    return 1;
+  }
+
+  double msPerTick = 1000.0 / cv::getTickFrequency() / n;
+  double total = (pipeline.ticks + encode.ticks) * msPerTick;
+  std::cout << "frames:        " << n << " (" << result->maskSize.width << "x" << result->maskSize.height
+            << " masks, " << result->image.cols << "x" << result->image.rows << " preview)\n";
+  reportPipeline(&pipeline, g, settings, n, msPerTick);
+  reportRefine(&refine, settings, n, msPerTick);
+  reportDetection(&detection, settings, n, msPerTick);
+  reportEncode(&encode, g, n, msPerTick);
+  reportThreshold(&threshold, settings, msPerTick);
+  reportMaskStage(&maskStage, settings, msPerTick);
+  reportMorphology(&morphology, msPerTick);
+  std::cout << "total:         " << total << " ms/frame (" << 1000.0 / total << " fps)" << std::endl;
+  return 0;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void currentPipelineSettings(struct pipelineSettings& s, void* data) {
   struct glob* g = (struct glob*) data;
 
   g->access.lock();
-  g->camera >> g->frame;
-  cv::resize(g->frame, g->frame, cv::Size(), g->imageScaling, g->imageScaling);
-  sendMat(g->frame, message);
+  s.version = g->settingsVersion;
+  s.imageScaling = g->imageScaling;
+  s.previewScaling = g->previewScaling;
+  s.refineScaling = g->refineScaling;
+  s.refineCandidates = g->refineCandidates;
+  s.classifier = g->classifier;
+  s.searchMode = g->searchMode;
+  s.roiMargin = g->roiMargin;
+  s.tiles = g->tiles;
+  s.profiles.resize(2);
+  s.profiles[ballProfile] = g->ball;
+  s.profiles[bgProfile] = g->bg;
+  s.detectProfile = ballProfile;
+  s.excludeProfile = g->detection.excludeBackground ? bgProfile : -1;
+  s.detection = g->detection;
+  s.tracking = g->tracking;
   g->access.unlock();
 }
 
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
-cv::Mat getMask(cv::Mat& frame, struct thresholdSettings s) {
-  std::vector<cv::Mat> chan;
-  cv::Mat hsv, mask_tmp, mask;
+std::shared_ptr<const struct frameResult> latestResult(struct glob* g) {
+  // only hold the settings lock long enough to copy them
+  struct pipelineSettings s;
+  currentPipelineSettings(s, g);
+  return g->pipeline.latest(g->capture, s);
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void encodeBase64(const unsigned char* raw, size_t size, std::string& encoded) {
+  // straight into the string, with room for the terminator b64_encode() writes
+  encoded.resize(b64e_size(size) + 1);
+  unsigned int length = b64_encode(raw, size, (unsigned char*) &encoded[0]);
+  encoded.resize(length);
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void encodeMat(const cv::Mat& mat, std::string& encoded, bool base64, int quality) {
+  // get raw JPEG bytes from frame, into a buffer each thread keeps
+  static thread_local std::vector<unsigned char> rawJpegBuffer;
+  std::vector<int> parameters;
+  parameters.push_back(cv::IMWRITE_JPEG_QUALITY);
+  parameters.push_back(quality);
+  cv::imencode(".jpeg", mat, rawJpegBuffer, parameters);
 
-  // build mask
-  cv::cvtColor(frame, hsv, cv::COLOR_BGR2HSV);
-  cv::split(hsv,chan);
-  if (s.hueMin < s.hueMax) {
-    cv::threshold(chan[0],mask,s.hueMax, 255, cv::THRESH_BINARY_INV);
-    cv::threshold(chan[0],mask_tmp,s.hueMin-1, 255, cv::THRESH_BINARY);
-    cv::bitwise_and(mask_tmp,mask,mask);
+  if (base64) {
+    encodeBase64(rawJpegBuffer.data(), rawJpegBuffer.size(), encoded);
   }
   else {
-    cv::threshold(chan[0],mask,s.hueMax, 255, cv::THRESH_BINARY_INV);
-    cv::threshold(chan[0],mask_tmp,s.hueMin-1, 255, cv::THRESH_BINARY);
-    cv::bitwise_or(mask_tmp,mask,mask);
+    encoded.assign(rawJpegBuffer.begin(), rawJpegBuffer.end());
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void encodeRuns(const bitMask& mask, std::string& encoded, bool base64) {
+  // get the run-length bytes; see runMask::serialize() for the format
+  static thread_local runMask runs;
+  static thread_local std::string raw;
+  runs.assign(mask, cv::Rect(0, 0, mask.cols(), mask.rows()));
+  if (!base64) {
+    runs.serialize(encoded);
+    return;
   }
+  runs.serialize(raw);
 
-  cv::threshold(chan[1],mask_tmp,s.satMax, 255, cv::THRESH_BINARY_INV);
-  cv::bitwise_and(mask_tmp,mask,mask);
-  cv::threshold(chan[1],mask_tmp,s.satMin-1, 255, cv::THRESH_BINARY);
-  cv::bitwise_and(mask_tmp,mask,mask);
+  encodeBase64((const unsigned char*) raw.data(), raw.size(), encoded);
+}
 
-  cv::threshold(chan[2],mask_tmp,s.valMax, 255, cv::THRESH_BINARY_INV);
-  cv::bitwise_and(mask_tmp,mask,mask);    
-  cv::threshold(chan[2],mask_tmp,s.valMin-1, 255, cv::THRESH_BINARY);
-  cv::bitwise_and(mask_tmp,mask,mask);
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
-  // erode / dilate mask
-  cv::erode(mask,mask,cv::Mat(),cv::Point(-1,-1),s.erosions);
-  cv::dilate(mask,mask,cv::Mat(),cv::Point(-1,-1),s.dilations);
+void encodePng(const bitMask& mask, std::string& encoded) {
+  // a 1-bit grayscale PNG at zlib's fastest level: lossless, and decoded by any <img>
+  static thread_local cv::Mat mat;
+  static thread_local std::vector<unsigned char> rawPngBuffer;
+  mask.toMat(mat);
+  std::vector<int> parameters;
+  parameters.push_back(cv::IMWRITE_PNG_BILEVEL);
+  parameters.push_back(1);
+  parameters.push_back(cv::IMWRITE_PNG_COMPRESSION);
+  parameters.push_back(1);
+  cv::imencode(".png", mat, rawPngBuffer, parameters);
+
+  encoded.assign(rawPngBuffer.begin(), rawPngBuffer.end());
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
-  return mask;
+// the cache's name for a JPEG encoding, e.g. "jpeg@95" or "jpeg-base64@95"
+static std::string jpegFormat(bool base64, int quality) {
+  return std::string(base64 ? "jpeg-base64@" : "jpeg@") + std::to_string(quality);
 }
 
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
-void serveBallMask(httpMessage message, void* data) {
+std::shared_ptr<const std::string> encodedImage(struct glob* g, const struct frameResult& result,
+                                                const std::string& output, const cv::Mat& mat,
+                                                bool base64, int quality) {
+  // every poll, stream and socket asking for this frame, output and quality gets the
+  // bytes encoded for the first one; the servers send straight from them
+  std::string format = jpegFormat(base64, quality);
+  std::shared_ptr<const std::string> encoded =
+    g->replies.find(result.id, result.settings.version, output, format);
+  if (!encoded) {
+    std::shared_ptr<std::string> fresh = std::make_shared<std::string>();
+    encodeMat(mat, *fresh, base64, quality);
+    g->replies.store(result.id, result.settings.version, output, format, fresh);
+    encoded = fresh;
+  }
+  return encoded;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+std::shared_ptr<const std::string> encodedMask(struct glob* g, const struct frameResult& result,
+                                               const std::string& output, const bitMask& mask,
+                                               bool base64, int quality) {
+  // masks are only unpacked when the reply isn't cached yet
+  std::shared_ptr<const std::string> encoded =
+    g->replies.find(result.id, result.settings.version, output, jpegFormat(base64, quality));
+  if (encoded) {
+    return encoded;
+  }
+  static thread_local cv::Mat mat;
+  mask.toMat(mat);
+  return encodedImage(g, result, output, mat, base64, quality);
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+std::shared_ptr<const std::string> encodedLossless(struct glob* g, const struct frameResult& result,
+                                                   const std::string& output, const bitMask& mask,
+                                                   const std::string& format, bool base64) {
+  // "png" or "rle", cached like the JPEGs; only runs are ever sent as base64
+  std::string key = format + (base64 ? "-base64" : "");
+  std::shared_ptr<const std::string> encoded =
+    g->replies.find(result.id, result.settings.version, output, key);
+  if (!encoded) {
+    std::shared_ptr<std::string> fresh = std::make_shared<std::string>();
+    if (format == "png") {
+      encodePng(mask, *fresh);
+    }
+    else {
+      encodeRuns(mask, *fresh, base64);
+    }
+    g->replies.store(result.id, result.settings.version, output, key, fresh);
+    encoded = fresh;
+  }
+  return encoded;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// the JPEG quality a request asks for with ?quality=, used exactly as given, or the
+// preview quality without one; replies with an error and returns false if it is not
+// in [1, 100]. Encodes are cached per exact quality, so viewers asking for the preview
+// quality share the default stream's
+static bool requestedQuality(struct glob* g, httpMessage& m, int& quality) {
+  quality = g->previewQuality;
+  std::string variable = m.getQueryVariable("quality");
+  if (variable == "") {
+    return true;
+  }
+  try {
+    quality = std::stoi(variable);
+  }
+  catch (std::invalid_argument error) {
+    m.replyHttpError(422, "Invalid number");
+    return false;
+  }
+  catch (std::out_of_range error) {
+    m.replyHttpError(422, "Quality must be in [1, 100]");
+    return false;
+  }
+  if (quality < 1 || quality > 100) {
+    m.replyHttpError(422, "Quality must be in [1, 100]");
+    return false;
+  }
+  return true;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void sendResult(struct glob* g, httpMessage& m, const struct frameResult& result,
+                const std::string& output, const cv::Mat& mat) {
+  // the JPEG bytes as they are, for <img src> or fetch().blob(); ?format=base64 sends
+  // them as base64 text, for clients that build data: URLs
+  int quality;
+  if (!requestedQuality(g, m, quality)) {
+    return;
+  }
+  bool base64 = m.getQueryVariable("format") == "base64";
+  m.replyHttpContent(base64 ? "text/plain" : "image/jpeg", *encodedImage(g, result, output, mat, base64, quality));
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void sendResult(struct glob* g, httpMessage& m, const struct frameResult& result,
+                const std::string& output, const bitMask& mask) {
+  // ?format=rle sends the runs as base64 text instead of a JPEG, a few hundred bytes
+  // for a ball mask; ?format=png sends a lossless 1-bit PNG
+  std::string format = m.getQueryVariable("format");
+  if (format == "rle") {
+    m.replyHttpContent("text/plain", *encodedLossless(g, result, output, mask, "rle", true));
+    return;
+  }
+  else if (format == "png") {
+    m.replyHttpContent("image/png", *encodedLossless(g, result, output, mask, "png", false));
+    return;
+  }
+
+  int quality;
+  if (!requestedQuality(g, m, quality)) {
+    return;
+  }
+  bool base64 = format == "base64";
+  m.replyHttpContent(base64 ? "text/plain" : "image/jpeg", *encodedMask(g, result, output, mask, base64, quality));
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// the newest result, if it is newer than the last part a stream was sent
+static std::shared_ptr<const struct frameResult> newerResult(struct glob* g, unsigned long& id) {
+  std::shared_ptr<const struct frameResult> result = g->pipeline.newest();
+  if (!result || result->id == id) {
+    return std::shared_ptr<const struct frameResult>();
+  }
+  id = result->id;
+  return result;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// a mask as its streams send it, in the maskFormat setting's encoding
+static std::shared_ptr<const std::string> streamedMask(struct glob* g, const struct frameResult& result,
+                                                       const std::string& output, const bitMask& mask) {
+  if (g->maskFormat == "png" || g->maskFormat == "rle") {
+    return encodedLossless(g, result, output, mask, g->maskFormat, false);
+  }
+  return encodedMask(g, result, output, mask, false, g->previewQuality);
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+std::shared_ptr<const std::string> streamCameraImage(unsigned long& id, void* data) {
   struct glob* g = (struct glob*) data;
+  std::shared_ptr<const struct frameResult> result = newerResult(g, id);
+  if (!result) {
+    return std::shared_ptr<const std::string>();
+  }
+  return encodedImage(g, *result, "cameraImage", result->image, false, g->previewQuality);
+}
 
-  cv::Mat mask;
-  bool ok = false;
-  
-  g->access.lock();
-  if (!g->frame.empty()) {
-    mask = getMask(g->frame, g->ball);
-    ok = true;
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+std::shared_ptr<const std::string> streamBallMask(unsigned long& id, void* data) {
+  struct glob* g = (struct glob*) data;
+  std::shared_ptr<const struct frameResult> result = newerResult(g, id);
+  if (!result) {
+    return std::shared_ptr<const std::string>();
   }
-  g->access.unlock();
+  return streamedMask(g, *result, "ballMask", result->masks[ballProfile]);
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
-  if (ok) {
-    sendMat(mask, message);
+std::shared_ptr<const std::string> streamBgMask(unsigned long& id, void* data) {
+  struct glob* g = (struct glob*) data;
+  std::shared_ptr<const struct frameResult> result = newerResult(g, id);
+  if (!result) {
+    return std::shared_ptr<const std::string>();
   }
-  else {
+  return streamedMask(g, *result, "bgMask", result->masks[bgProfile]);
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void publishResult(std::shared_ptr<const struct frameResult> result, void* data) {
+  struct glob* g = (struct glob*) data;
+  g->server->notifyStreams();
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void serveCameraImage(httpMessage message,
+                      void* data) {
+  struct glob* g = (struct glob*) data;
+
+  std::shared_ptr<const struct frameResult> result = latestResult(g);
+  if (!result) {
     message.replyHttpError(503, "Frame not yet loaded");
+    return;
+  }
+
+  // ?scale= picks a level of the frame's pyramid instead of the preview: 1 for a
+  // full-resolution snapshot, down to 1/16 for thumbnails. Scales are rounded to
+  // powers of two so clients can't make the pyramid keep arbitrarily many levels
+  std::string variable = message.getQueryVariable("scale");
+  if (variable == "") {
+    sendResult(g, message, *result, "cameraImage", result->image);
+    return;
   }
+  double scale = 0;
+  try {
+    scale = std::stod(variable);
+  }
+  catch (std::invalid_argument error) {
+    message.replyHttpError(422, "Invalid number");
+    return;
+  }
+  catch (std::out_of_range error) {
+    message.replyHttpError(422, "Scale must be in (0, 1]");
+    return;
+  }
+  if (!(scale > 0 && scale <= 1)) {
+    message.replyHttpError(422, "Scale must be in (0, 1]");
+    return;
+  }
+  int octave = std::min(maxThumbnailOctave, (int) std::lround(-std::log2(scale)));
+  scale = std::ldexp(1.0, -octave);
+  sendResult(g, message, *result, "cameraImage@" + std::to_string(octave), result->pyramid.bgr(scale));
 }
 
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
-void serveBgMask(httpMessage message, void* data) {
+void serveBallMask(httpMessage message, void* data) {
   struct glob* g = (struct glob*) data;
 
-  cv::Mat mask;
-  bool ok = false;
-  
-  g->access.lock();
-  if (!g->frame.empty()) {
-    mask = getMask(g->frame, g->bg);
-    ok = true;
+  std::shared_ptr<const struct frameResult> result = latestResult(g);
+  if (!result) {
+    message.replyHttpError(503, "Frame not yet loaded");
+    return;
   }
-  g->access.unlock();
 
-  if (ok) {
-    sendMat(mask, message);
+  sendResult(g, message, *result, "ballMask", result->masks[ballProfile]);
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void serveBgMask(httpMessage message, void* data) {
+  struct glob* g = (struct glob*) data;
+
+  std::shared_ptr<const struct frameResult> result = latestResult(g);
+  if (!result) {
+    message.replyHttpError(503, "Frame not yet loaded");
+    return;
   }
-  else {
+
+  sendResult(g, message, *result, "bgMask", result->masks[bgProfile]);
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void serveBallState(httpMessage message, void* data) {
+  struct glob* g = (struct glob*) data;
+
+  std::shared_ptr<const struct frameResult> result = latestResult(g);
+  if (!result) {
     message.replyHttpError(503, "Frame not yet loaded");
+    return;
+  }
+
+  // latency-compensated estimate, optionally for some time ahead of now
+  double ahead = 0;
+  try {
+    std::string variable = message.getQueryVariable("ahead");
+    if (variable != "") {
+      ahead = std::stod(variable);
+    }
+  }
+  catch (std::invalid_argument error) {
+    message.replyHttpError(422, "Invalid number");
+    return;
+  }
+  catch (std::out_of_range error) {
+    message.replyHttpError(422, "Invalid number");
+    return;
+  }
+  if (!std::isfinite(ahead)) {
+    message.replyHttpError(422, "Invalid number");
+    return;
+  }
+  // the time point is an integer count of ticks, and a prediction far ahead means
+  // nothing anyway
+  ahead = std::max(0.0, std::min(ahead, maxPredictionAhead));
+
+  std::string buffer;
+  ballStateJson(g, *result, ahead, buffer);
+  message.replyHttpContent("text/plain", buffer);
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void ballStateJson(struct glob* g, const struct frameResult& result, double ahead, std::string& buffer) {
+  const struct ballState& ball = result.ball;
+  double age = std::chrono::duration<double, std::milli>(frameClock::now() - result.timestamp).count();
+
+  buffer = "{";
+  buffer += "\"frame\":";
+  buffer += std::to_string(result.id);
+  buffer += ",\"ageMs\":";
+  buffer += std::to_string(age);
+  buffer += ",\"found\":";
+  buffer += ball.found ? "true" : "false";
+  buffer += ",\"x\":";
+  buffer += std::to_string(ball.center.x);
+  buffer += ",\"y\":";
+  buffer += std::to_string(ball.center.y);
+  buffer += ",\"area\":";
+  buffer += std::to_string(ball.area);
+  buffer += ",\"bbox\":[";
+  buffer += std::to_string(ball.bbox.x) + ",";
+  buffer += std::to_string(ball.bbox.y) + ",";
+  buffer += std::to_string(ball.bbox.width) + ",";
+  buffer += std::to_string(ball.bbox.height) + "]";
+  buffer += ",\"confidence\":";
+  buffer += std::to_string(ball.confidence);
+  buffer += ",\"orientation\":";
+  buffer += std::to_string(ball.orientation);
+  buffer += ",\"axes\":[";
+  buffer += std::to_string(ball.axes.width) + ",";
+  buffer += std::to_string(ball.axes.height) + "]";
+
+  frameClock::time_point when = frameClock::now() +
+    std::chrono::duration_cast<frameClock::duration>(std::chrono::duration<double, std::milli>(ahead));
+  struct trackedBall predicted = g->pipeline.predictBall(when);
+
+  buffer += ",\"predicted\":{\"valid\":";
+  buffer += predicted.valid ? "true" : "false";
+  buffer += ",\"x\":";
+  buffer += std::to_string(predicted.position.x);
+  buffer += ",\"y\":";
+  buffer += std::to_string(predicted.position.y);
+  buffer += ",\"vx\":";
+  buffer += std::to_string(predicted.velocity.x);
+  buffer += ",\"vy\":";
+  buffer += std::to_string(predicted.velocity.y);
+  buffer += ",\"uncertainty\":";
+  buffer += std::to_string(predicted.uncertainty);
+  buffer += ",\"horizonMs\":";
+  buffer += std::to_string(predicted.horizon);
+  buffer += "}}";
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+std::shared_ptr<const std::string> streamBallState(unsigned long& id, void* data) {
+  struct glob* g = (struct glob*) data;
+  std::shared_ptr<const struct frameResult> result = newerResult(g, id);
+  if (!result) {
+    return std::shared_ptr<const std::string>();
   }
+  std::shared_ptr<std::string> state = std::make_shared<std::string>();
+  ballStateJson(g, *result, 0, *state);
+  return state;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void serveStats(httpMessage message, void* data) {
+  struct glob* g = (struct glob*) data;
+
+  struct pipelineStats stats = g->pipeline.getStats();
+
+  std::string buffer = "{";
+  buffer += "\"frames\":";
+  buffer += std::to_string(stats.frames);
+  buffer += ",\"windowedFrames\":";
+  buffer += std::to_string(stats.windowedFrames);
+  buffer += ",\"processedFraction\":";
+  buffer += std::to_string(stats.processedFraction);
+  buffer += ",\"averageFraction\":";
+  buffer += std::to_string(stats.averageFraction);
+  buffer += ",\"allocations\":";
+  buffer += std::to_string(stats.allocations);
+  buffer += "}";
+
+  message.replyHttpContent("text/plain", buffer);
 }
 
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
@@ -236,6 +1640,8 @@ void serveBallSettings(httpMessage message, void* data) {
   buffer += std::to_string(g->ball.erosions);
   buffer += ",\"dilations\":";
   buffer += std::to_string(g->ball.dilations);
+  buffer += ",\"morphology\":";
+  buffer += std::to_string(g->ball.morphology);
   buffer += "}";
   
   message.replyHttpContent("text/plain", buffer);
@@ -257,15 +1663,31 @@ void setBallSettings(httpMessage message, void* data) {
     settings.valMin    = std::stoi(message.getHttpVariable("valMin"));   
     settings.erosions  = std::stoi(message.getHttpVariable("erosions"));   
     settings.dilations = std::stoi(message.getHttpVariable("dilations"));
+    std::string morphology = message.getHttpVariable("morphology");
+    settings.morphology = morphology.empty() ? -1 : std::stoi(morphology);
   }
   catch(std::invalid_argument error) {
     std::cerr << "error: invalid argument encountered in setBallSettings()" << std::endl;
     message.replyHttpError(422,"Invalid number");
     return;
   }
+  catch (std::out_of_range error) {
+    message.replyHttpError(422,"Invalid number");
+    return;
+  }
+
+  if (!validMorphologyPasses(settings)) {
+    message.replyHttpError(422,"Erosions and dilations must be in [0, 32]");
+    return;
+  }
   
   g->access.lock();
+  // pages that don't send a morphology mode keep the current one
+  if (settings.morphology != morphologyIterated && settings.morphology != morphologyBox) {
+    settings.morphology = g->ball.morphology;
+  }
   g->ball = settings;
+  g->settingsVersion++;
   g->access.unlock();
 
   message.replyHttpOk();
@@ -295,6 +1717,8 @@ void serveBgSettings(httpMessage message, void* data) {
   buffer += std::to_string(g->bg.erosions);
   buffer += ",\"dilations\":";
   buffer += std::to_string(g->bg.dilations);
+  buffer += ",\"morphology\":";
+  buffer += std::to_string(g->bg.morphology);
   buffer += "}";
   
   message.replyHttpContent("text/plain", buffer);
@@ -316,15 +1740,31 @@ void setBgSettings(httpMessage message, void* data) {
     settings.valMin    = std::stoi(message.getHttpVariable("valMin"));   
     settings.erosions  = std::stoi(message.getHttpVariable("erosions"));   
     settings.dilations = std::stoi(message.getHttpVariable("dilations"));
+    std::string morphology = message.getHttpVariable("morphology");
+    settings.morphology = morphology.empty() ? -1 : std::stoi(morphology);
   }
   catch (std::invalid_argument error) {
     std::cerr << "error: invalid argument encountered in setBgSettings()" << std::endl;
     message.replyHttpError(422,"Invalid number");
     return;
   }
+  catch (std::out_of_range error) {
+    message.replyHttpError(422,"Invalid number");
+    return;
+  }
+
+  if (!validMorphologyPasses(settings)) {
+    message.replyHttpError(422,"Erosions and dilations must be in [0, 32]");
+    return;
+  }
   
   g->access.lock();
+  // pages that don't send a morphology mode keep the current one
+  if (settings.morphology != morphologyIterated && settings.morphology != morphologyBox) {
+    settings.morphology = g->bg.morphology;
+  }
   g->bg = settings;
+  g->settingsVersion++;
   g->access.unlock();
 
   message.replyHttpOk();
@@ -332,6 +1772,16 @@ void setBgSettings(httpMessage message, void* data) {
 
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
+template<typename T>
+static void readSetting(const cv::FileNode& node, const char* key, T& value) {
+  // keep the default if the key is missing, e.g. in older settings files
+  if (!node[key].empty()) {
+    node[key] >> value;
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
 bool loadSettings(struct glob* g) {
   cv::FileStorage fs;
   fs.open(g->settingsFile, cv::FileStorage::READ);
@@ -349,6 +1799,11 @@ bool loadSettings(struct glob* g) {
   node["valMin"]    >> g->ball.valMin;   
   node["erosions"]  >> g->ball.erosions; 
   node["dilations"] >> g->ball.dilations;
+  readSetting(node, "morphology", g->ball.morphology);
+  if (!validMorphologyPasses(g->ball)) {
+    std::cerr << "error: ballSettings erosions and dilations must be in [0, " << maxMorphologyPasses << "]" << std::endl;
+    return false;
+  }
 
   node = fs["bgSettings"];
   node["hueMax"]    >> g->bg.hueMax;    
@@ -359,6 +1814,67 @@ bool loadSettings(struct glob* g) {
   node["valMin"]    >> g->bg.valMin;   
   node["erosions"]  >> g->bg.erosions; 
   node["dilations"] >> g->bg.dilations;
+  readSetting(node, "morphology", g->bg.morphology);
+  if (!validMorphologyPasses(g->bg)) {
+    std::cerr << "error: bgSettings erosions and dilations must be in [0, " << maxMorphologyPasses << "]" << std::endl;
+    return false;
+  }
+
+  node = fs["source"];
+  readSetting(node, "type",   g->source.type);
+  readSetting(node, "camera", g->source.camera);
+  readSetting(node, "path",   g->source.path);
+  readSetting(node, "fps",    g->source.fps);
+  readSetting(node, "fast",   g->source.fast);
+  readSetting(node, "loop",   g->source.loop);
+  readSetting(node, "width",  g->source.width);
+  readSetting(node, "height", g->source.height);
+  readSetting(node, "format", g->source.format);
+
+  node = fs["resolution"];
+  readSetting(node, "detection", g->imageScaling);
+  readSetting(node, "refine",    g->refineScaling);
+  readSetting(node, "candidates", g->refineCandidates);
+  readSetting(node, "preview",   g->previewScaling);
+  readSetting(node, "quality",   g->previewQuality);
+  g->previewQuality = std::max(1, std::min(g->previewQuality, 100));
+  readSetting(node, "maskFormat", g->maskFormat);
+
+  node = fs["pipeline"];
+  readSetting(node, "classifier", g->classifier);
+  readSetting(node, "searchMode", g->searchMode);
+  readSetting(node, "roiMargin",  g->roiMargin);
+  readSetting(node, "tiles",      g->tiles);
+  if (!validTiles(g->tiles)) {
+    std::cerr << "error: pipeline tiles must be between 1 and the number of hardware threads ("
+              << std::thread::hardware_concurrency() << ")" << std::endl;
+    return false;
+  }
+
+  node = fs["detection"];
+  readSetting(node, "excludeBackground", g->detection.excludeBackground);
+  readSetting(node, "minArea",           g->detection.minArea);
+  readSetting(node, "method",            g->detection.method);
+
+  node = fs["tracking"];
+  readSetting(node, "processNoise",     g->tracking.processNoise);
+  readSetting(node, "measurementNoise", g->tracking.measurementNoise);
+  readSetting(node, "latency",          g->tracking.latency);
+  readSetting(node, "lostTimeout",      g->tracking.lostTimeout);
+
+  node = fs["synthetic"];
+  readSetting(node, "trajectory",    g->source.scene.trajectory);
+  readSetting(node, "waypoints",     g->source.scene.waypoints);
+  readSetting(node, "speed",         g->source.scene.speed);
+  readSetting(node, "radius",        g->source.scene.radius);
+  readSetting(node, "ballHue",       g->source.scene.ballHue);
+  readSetting(node, "ballSat",       g->source.scene.ballSat);
+  readSetting(node, "ballVal",       g->source.scene.ballVal);
+  readSetting(node, "noise",         g->source.scene.noise);
+  readSetting(node, "motionBlur",    g->source.scene.motionBlur);
+  readSetting(node, "lightingDrift", g->source.scene.lightingDrift);
+  readSetting(node, "driftPeriod",   g->source.scene.driftPeriod);
+  readSetting(node, "seed",          g->source.scene.seed);
 
   return true;
 }
@@ -385,6 +1901,7 @@ void saveSettings(httpMessage message, void* data) {
   fs << "valMin"    << g->ball.valMin;  
   fs << "erosions"  << g->ball.erosions;
   fs << "dilations" << g->ball.dilations;
+  fs << "morphology" << g->ball.morphology;
   fs << "}";
 
   fs << "bgSettings" << "{";
@@ -396,6 +1913,63 @@ void saveSettings(httpMessage message, void* data) {
   fs << "valMin"    << g->bg.valMin;  
   fs << "erosions"  << g->bg.erosions;
   fs << "dilations" << g->bg.dilations;
+  fs << "morphology" << g->bg.morphology;
+  fs << "}";
+
+  fs << "source" << "{";
+  fs << "type"   << g->fileSource.type;
+  fs << "camera" << g->fileSource.camera;
+  fs << "path"   << g->fileSource.path;
+  fs << "fps"    << g->fileSource.fps;
+  fs << "fast"   << g->fileSource.fast;
+  fs << "loop"   << g->fileSource.loop;
+  fs << "width"  << g->fileSource.width;
+  fs << "height" << g->fileSource.height;
+  fs << "format" << g->fileSource.format;
+  fs << "}";
+
+  fs << "resolution" << "{";
+  fs << "detection" << g->imageScaling;
+  fs << "refine"    << g->refineScaling;
+  fs << "candidates" << g->refineCandidates;
+  fs << "preview"   << g->previewScaling;
+  fs << "quality"   << g->previewQuality;
+  fs << "maskFormat" << g->maskFormat;
+  fs << "}";
+
+  fs << "pipeline" << "{";
+  fs << "classifier" << g->classifier;
+  fs << "searchMode" << g->searchMode;
+  fs << "roiMargin"  << g->roiMargin;
+  fs << "tiles"      << g->fileTiles;
+  fs << "}";
+
+  fs << "detection" << "{";
+  fs << "excludeBackground" << g->detection.excludeBackground;
+  fs << "minArea"           << g->detection.minArea;
+  fs << "method"            << g->detection.method;
+  fs << "}";
+
+  fs << "tracking" << "{";
+  fs << "processNoise"     << g->tracking.processNoise;
+  fs << "measurementNoise" << g->tracking.measurementNoise;
+  fs << "latency"          << g->tracking.latency;
+  fs << "lostTimeout"      << g->tracking.lostTimeout;
+  fs << "}";
+
+  fs << "synthetic" << "{";
+  fs << "trajectory"    << g->fileSource.scene.trajectory;
+  fs << "waypoints"     << g->fileSource.scene.waypoints;
+  fs << "speed"         << g->fileSource.scene.speed;
+  fs << "radius"        << g->fileSource.scene.radius;
+  fs << "ballHue"       << g->fileSource.scene.ballHue;
+  fs << "ballSat"       << g->fileSource.scene.ballSat;
+  fs << "ballVal"       << g->fileSource.scene.ballVal;
+  fs << "noise"         << g->fileSource.scene.noise;
+  fs << "motionBlur"    << g->fileSource.scene.motionBlur;
+  fs << "lightingDrift" << g->fileSource.scene.lightingDrift;
+  fs << "driftPeriod"   << g->fileSource.scene.driftPeriod;
+  fs << "seed"          << g->fileSource.scene.seed;
   fs << "}";
 
   std::cout << "saved." << std::endl;
@@ -0,0 +1,143 @@
+#include "maskLut.hpp"
+#include "pixelFormat.hpp"
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// erosions and dilations don't affect the table
+static bool sameBounds(const struct thresholdSettings& a, const struct thresholdSettings& b) {
+  return a.hueMin == b.hueMin && a.hueMax == b.hueMax &&
+         a.satMin == b.satMin && a.satMax == b.satMax &&
+         a.valMin == b.valMin && a.valMax == b.valMax;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+maskLut::maskLut() :
+  table(),
+  buildPending(false),
+  stopping(false),
+  hasRequest(false),
+  requestedYuv(false) {
+  builder = std::thread{&maskLut::buildLoop, this};
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+maskLut::~maskLut() {
+  requestMutex.lock();
+  stopping = true;
+  requestMutex.unlock();
+  requestSignal.notify_one();
+  if (builder.joinable()) {
+    builder.join();
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+std::shared_ptr<const struct lutTable> maskLut::compile(const struct thresholdSettings& s, bool yuv) {
+  std::shared_ptr<struct lutTable> t = std::make_shared<struct lutTable>();
+  t->settings = s;
+  t->yuv = yuv;
+  t->bits.assign((1 << 24) / 8, 0);
+
+  // one row of 256 blues per (red, green) pair, packed 8 pixels to a byte; for YUV,
+  // 256 lumas per (v, u) pair, converted to the BGR the camera's frame would give
+  unsigned char colors[256*3];
+  unsigned char converted[256*3];
+  unsigned char row[256];
+  for (int rg = 0; rg < (1 << 16); rg++) {
+    for (int b = 0; b < 256; b++) {
+      colors[3*b + 0] = b;
+      colors[3*b + 1] = rg & 0xff;
+      colors[3*b + 2] = rg >> 8;
+    }
+    if (yuv) {
+      yuvToBgrRow(colors, converted, 256);
+      hsvThresholdRow(converted, row, 256, s);
+    }
+    else {
+      hsvThresholdRow(colors, row, 256, s);
+    }
+
+    unsigned char* bits = &t->bits[rg * 32];
+    for (int b = 0; b < 256; b++) {
+      bits[b >> 3] |= (row[b] & 1) << (b & 7);
+    }
+  }
+  return t;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void maskLut::build(const struct thresholdSettings& s, bool yuv) {
+  std::atomic_store(&table, compile(s, yuv));
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void maskLut::buildLoop() {
+  while (true) {
+    std::unique_lock<std::mutex> lock(requestMutex);
+    requestSignal.wait(lock, [this] { return buildPending || stopping; });
+    if (stopping) {
+      return;
+    }
+    struct thresholdSettings s = requested;
+    bool yuv = requestedYuv;
+    buildPending = false;
+    lock.unlock();
+
+    // a newer request may arrive while this one compiles; the loop picks it up next
+    std::atomic_store(&table, compile(s, yuv));
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+std::shared_ptr<const struct lutTable> maskLut::tableFor(const struct thresholdSettings& s, bool yuv) {
+  std::shared_ptr<const struct lutTable> t = std::atomic_load(&table);
+
+  if (!t || !sameBounds(t->settings, s) || t->yuv != yuv) {
+    // only ask once per set of bounds, even while that build is still running
+    requestMutex.lock();
+    if (!hasRequest || !sameBounds(requested, s) || requestedYuv != yuv) {
+      requested = s;
+      requestedYuv = yuv;
+      hasRequest = true;
+      buildPending = true;
+      requestSignal.notify_one();
+    }
+    requestMutex.unlock();
+    return std::shared_ptr<const struct lutTable>();
+  }
+  return t;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void maskLut::applyRow(const struct lutTable& t, const uchar* bgr, uchar* mask, int width) {
+  const unsigned char* bits = t.bits.data();
+  for (int x = 0; x < width; x++, bgr += 3) {
+    unsigned int index = bgr[0] | (bgr[1] << 8) | (bgr[2] << 16);
+    mask[x] = -((bits[index >> 3] >> (index & 7)) & 1);
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+bool maskLut::apply(const cv::Mat& bgr, cv::Mat& mask, const struct thresholdSettings& s) {
+  std::shared_ptr<const struct lutTable> t = tableFor(s);
+  if (!t) {
+    return false;
+  }
+
+  CV_Assert(bgr.type() == CV_8UC3);
+  mask.create(bgr.size(), CV_8UC1);
+  for (int y = 0; y < bgr.rows; y++) {
+    applyRow(*t, bgr.ptr<uchar>(y), mask.ptr<uchar>(y), bgr.cols);
+  }
+  return true;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
@@ -0,0 +1,119 @@
+/*! @file
+ * Defines the maskLut class, which compiles a set of HSV bounds into a lookup table
+ * over every 24-bit BGR or YUV color so that classifying a pixel is a single table read.
+ */
+
+#ifndef SMM_MASK_LUT_HPP
+#define SMM_MASK_LUT_HPP
+
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <opencv2/core.hpp>
+
+#include "hsvThreshold.hpp"
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+/*! @brief A compiled table: one bit per BGR or YUV color, 2 MB in total. */
+struct lutTable {
+  /*! @brief The bounds the table was compiled from. */
+  struct thresholdSettings settings;
+  /*! @brief @c True if the table is indexed by Y U V rather than B G R. */
+  bool yuv;
+  /*! @brief Bit @c (r<<16 | g<<8 | b), or @c (v<<16 | u<<8 | y), is set if that color
+   * is inside the bounds. */
+  std::vector<unsigned char> bits;
+};
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+/*! @class maskLut
+ * @brief A BGR-to-mask lookup table that rebuilds itself in the background.
+ *
+ * The table is compiled with hsvThresholdRow(), so it gives exactly the same mask as
+ * hsvThreshold(). A YUV table is compiled by converting each color to BGR with
+ * yuvToBgrRow() first, so it classifies a camera's YUV pixels exactly as converting
+ * them with cv::cvtColor() and thresholding the result would, with neither conversion
+ * done per frame. When apply() is called with bounds the current table was not built
+ * from, it schedules a rebuild on its worker thread and returns @c False so the
+ * caller can fall back to hsvThreshold() for that frame. The finished table is
+ * swapped in atomically; frames already being classified keep the old one.
+ */
+class maskLut {
+private:
+  void buildLoop();
+
+  std::shared_ptr<const struct lutTable> table;
+
+  std::thread builder;
+  std::mutex requestMutex;
+  std::condition_variable requestSignal;
+  bool buildPending;
+  bool stopping;
+  bool hasRequest;
+  struct thresholdSettings requested;
+  bool requestedYuv;
+
+public:
+  /*! @brief maskLut constructor. Starts the worker thread. */
+  maskLut();
+
+  /*! @brief maskLut destructor. Stops the worker thread. */
+  ~maskLut();
+
+  /*! @brief Classify an image through the table.
+   *
+   * @param bgr The 8-bit, 3-channel BGR image.
+   * @param mask Receives the 8-bit mask. Its buffer is reused when the size matches.
+   * @param s The bounds to apply.
+   *
+   * @returns @c True if the mask was produced; @c False if no table for @c s is ready
+   * yet, in which case a rebuild has been scheduled and @c mask is untouched.
+   */
+  bool apply(const cv::Mat& bgr, cv::Mat& mask, const struct thresholdSettings& s);
+
+  /*! @brief Get the table for some bounds.
+   *
+   * @param s The bounds.
+   * @param yuv @c True for a table indexed by Y U V.
+   *
+   * @returns The table, or an empty pointer if none for @c s is ready yet, in which
+   * case a rebuild has been scheduled.
+   */
+  std::shared_ptr<const struct lutTable> tableFor(const struct thresholdSettings& s, bool yuv = false);
+
+  /*! @brief Classify a row of BGR pixels, or Y U V ones with a YUV table, through a table.
+   *
+   * @param t The table.
+   * @param bgr Pointer to @c width packed pixels of three bytes each.
+   * @param mask Pointer to @c width output bytes, set to 255 inside the bounds and 0 outside.
+   * @param width Number of pixels in the row.
+   */
+  static void applyRow(const struct lutTable& t, const uchar* bgr, uchar* mask, int width);
+
+  /*! @brief Build the table for some bounds on the calling thread.
+   *
+   * Useful when the table must be ready before the first frame, e.g. for benchmarks.
+   *
+   * @param s The bounds to compile.
+   * @param yuv @c True for a table indexed by Y U V.
+   */
+  void build(const struct thresholdSettings& s, bool yuv = false);
+
+  /*! @brief Compile a table for some bounds.
+   *
+   * @param s The bounds to compile.
+   * @param yuv @c True for a table indexed by Y U V.
+   *
+   * @returns The compiled table.
+   */
+  static std::shared_ptr<const struct lutTable> compile(const struct thresholdSettings& s, bool yuv = false);
+};
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#endif
@@ -0,0 +1,63 @@
+#include <cmath>
+#include <algorithm>
+
+#include "maskMoments.hpp"
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// 0^2 + 1^2 + ... + k^2
+static double sumOfSquares(double k) {
+  return k * (k + 1) * (2*k + 1) / 6;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void maskMoments::addRun(int y, int start, int end) {
+  double count = end - start;
+  double sumX = (double) (start + end - 1) * count / 2;
+  double sumXX = sumOfSquares(end - 1) - (start > 0 ? sumOfSquares(start - 1) : 0);
+  addRow(y, count, sumX, sumXX);
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+maskMoments& maskMoments::operator+=(const maskMoments& other) {
+  m00 += other.m00;
+  m10 += other.m10;
+  m01 += other.m01;
+  m20 += other.m20;
+  m11 += other.m11;
+  m02 += other.m02;
+  return *this;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+cv::Point2d maskMoments::centroid() const {
+  return cv::Point2d(m10 / m00, m01 / m00);
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void maskMoments::ellipse(double& orientation, double& major, double& minor) const {
+  if (m00 <= 0) {
+    orientation = major = minor = 0;
+    return;
+  }
+
+  // central second moments per pixel, i.e. the covariance of the coordinates
+  cv::Point2d c = centroid();
+  double xx = m20 / m00 - c.x * c.x;
+  double xy = m11 / m00 - c.x * c.y;
+  double yy = m02 / m00 - c.y * c.y;
+
+  // its eigenvalues are the variances along the axes; a filled ellipse with
+  // semi-axis a has variance a^2/4 along it
+  double mean = (xx + yy) / 2;
+  double spread = std::sqrt((xx - yy) * (xx - yy) / 4 + xy * xy);
+  orientation = 0.5 * std::atan2(2 * xy, xx - yy);
+  major = 4 * std::sqrt(std::max(mean + spread, 0.0));
+  minor = 4 * std::sqrt(std::max(mean - spread, 0.0));
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
@@ -0,0 +1,69 @@
+/*! @file
+ * Defines the maskMoments struct, the raw image moments of a binary mask up to
+ * second order.
+ */
+
+#ifndef SMM_MASK_MOMENTS_HPP
+#define SMM_MASK_MOMENTS_HPP
+
+#include <opencv2/core.hpp>
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+/*! @brief Raw moments of a set of pixels, with pixel @c (x, y) at its integer coordinates.
+ *
+ * Moments add up, so they can be accumulated a row, a run or a tile at a time and
+ * summed with @c +=. The centroid and the ellipse with the same second moments
+ * follow from them without another look at the pixels.
+ */
+struct maskMoments {
+  double m00;
+  double m10;
+  double m01;
+  double m20;
+  double m11;
+  double m02;
+
+  maskMoments() : m00(0), m10(0), m01(0), m20(0), m11(0), m02(0) {}
+
+  /*! @brief Add the set pixels of one row, given as sums over their x coordinates.
+   *
+   * @param y The row.
+   * @param count Number of pixels.
+   * @param sumX Sum of their x coordinates.
+   * @param sumXX Sum of their squared x coordinates.
+   */
+  void addRow(int y, double count, double sumX, double sumXX) {
+    m00 += count;
+    m10 += sumX;
+    m01 += (double) y * count;
+    m20 += sumXX;
+    m11 += (double) y * sumX;
+    m02 += (double) y * y * count;
+  }
+
+  /*! @brief Add pixels @c start to <tt>end-1</tt> of row @c y. */
+  void addRun(int y, int start, int end);
+
+  /*! @brief Add the pixels of another set. */
+  maskMoments& operator+=(const maskMoments& other);
+
+  /*! @brief Returns the mean position of the pixels; only meaningful if @c m00 > 0. */
+  cv::Point2d centroid() const;
+
+  /*! @brief Get the ellipse with the same area-normalized second moments.
+   *
+   * For a filled ellipse this gives back its own axes; for a disc of radius r both
+   * axes come out as 2r.
+   *
+   * @param orientation Receives the angle of the major axis to the x axis, in radians,
+   * between -pi/2 and pi/2. Angles increase towards +y, i.e. clockwise on screen.
+   * @param major Receives the length of the major axis.
+   * @param minor Receives the length of the minor axis.
+   */
+  void ellipse(double& orientation, double& major, double& minor) const;
+};
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#endif
@@ -0,0 +1,681 @@
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <algorithm>
+
+#include <opencv2/imgproc.hpp>
+
+#include "pipeline.hpp"
+#include "allocationCounter.hpp"
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// smallest search window, in scaled pixels either side of the predicted center
+static const int minWindowHalfSize = 8;
+
+// frames the average processed fraction is taken over, roughly
+static const unsigned long statsWindow = 100;
+
+// results kept for reuse: the published one, the one being computed, and spares for
+// readers that hold on to older ones
+static const size_t spareResults = 4;
+
+// detection pixels added around the ball's box before it is refined, so its edge,
+// and what the morphology took off it, are inside the window
+static const double refineMargin = 2;
+
+// frames with unchanged settings and size before a frame that allocates is an error;
+// enough for the buffers to reach the size the scene needs
+static const unsigned long warmupFrames = 30;
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+framePipeline::framePipeline() :
+  thread{},
+  running(false),
+  capture(NULL),
+  settingsCallback(NULL),
+  resultCallback(NULL),
+  settingsData(NULL),
+  processMutex(),
+  input(),
+  result(),
+  luts(),
+  pool(),
+  tracker(),
+  detector(),
+  lastBall(),
+  results(),
+  nextResult(0),
+  scratch(),
+  work(),
+  yuvPlanes(),
+  refineBuffer(),
+  refineRow(),
+  refineExcluded(),
+  refineBgr(),
+  refineColumns(),
+  candidates(),
+  steadyVersion(0),
+  steadySize(),
+  steadyFrames(0),
+  statsMutex(),
+  stats() {
+  for (size_t i = 0; i < spareResults; i++) {
+    results.push_back(std::make_shared<struct frameResult>());
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+framePipeline::~framePipeline() {
+  shutdown();
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void framePipeline::launch(captureThread* capture, settingsCallback_t settings, void* data,
+                           resultCallback_t published) {
+  this->capture = capture;
+  settingsCallback = settings;
+  resultCallback = published;
+  settingsData = data;
+  running = true;
+  thread = std::thread{&framePipeline::processLoop, this};
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void framePipeline::shutdown() {
+  running = false;
+  if (thread.joinable()) {
+    thread.join();
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+bool framePipeline::isRunning() {
+  return running;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void framePipeline::processLoop() {
+  unsigned long lastId = 0;
+  struct pipelineSettings settings;
+  while (running) {
+    // time out now and then so shutdown() is noticed after the source ends
+    if (!capture->waitForFrame(lastId, std::chrono::milliseconds(100))) {
+      continue;
+    }
+    settingsCallback(settings, settingsData);
+    std::shared_ptr<const struct frameResult> r = latest(*capture, settings);
+    if (r) {
+      lastId = r->id;
+      if (resultCallback) {
+        resultCallback(r, settingsData);
+      }
+    }
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+std::shared_ptr<const struct frameResult> framePipeline::newest() {
+  return std::atomic_load(&result);
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+struct trackedBall framePipeline::predictBall(frameClock::time_point when) {
+  return tracker.predict(when);
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void framePipeline::resetTracker() {
+  processMutex.lock();
+  tracker.reset();
+  lastBall = ballState();
+  processMutex.unlock();
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+struct pipelineStats framePipeline::getStats() {
+  statsMutex.lock();
+  struct pipelineStats s = stats;
+  statsMutex.unlock();
+  return s;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+std::shared_ptr<const struct frameResult> framePipeline::latest(captureThread& capture,
+                                                                const struct pipelineSettings& s) {
+  processMutex.lock();
+  if (!capture.latest(input)) {
+    processMutex.unlock();
+    return std::shared_ptr<const struct frameResult>();
+  }
+
+  if (!result || result->id != input.id || result->settings.version != s.version) {
+    // published atomically so newest() never waits on a computation
+    std::atomic_store(&result, compute(input, s));
+  }
+  std::shared_ptr<const struct frameResult> r = result;
+  processMutex.unlock();
+  return r;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+std::shared_ptr<const struct frameResult> framePipeline::process(const capturedFrame& frame,
+                                                                 const struct pipelineSettings& s) {
+  processMutex.lock();
+  std::shared_ptr<const struct frameResult> r = compute(frame, s);
+  processMutex.unlock();
+  return r;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void framePipeline::prepare(const struct pipelineSettings& s, int format) {
+  if (s.classifier != "lut") {
+    return;
+  }
+  processMutex.lock();
+  while (luts.size() < s.profiles.size()) {
+    luts.emplace_back(new maskLut());
+  }
+  for (size_t i = 0; i < s.profiles.size(); i++) {
+    luts[i]->build(s.profiles[i], format != pixelBgr);
+  }
+  processMutex.unlock();
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+cv::Rect framePipeline::searchWindow(const capturedFrame& frame, const struct pipelineSettings& s,
+                                     cv::Size size) {
+  cv::Rect full(0, 0, size.width, size.height);
+  if (s.searchMode != "roi" || !lastBall.found) {
+    return full;
+  }
+
+  // where the ball should be when this frame was exposed
+  frameClock::time_point exposure = frame.timestamp -
+    std::chrono::duration_cast<frameClock::duration>(std::chrono::duration<double, std::milli>(s.tracking.latency));
+  struct trackedBall predicted = tracker.predict(exposure);
+  if (!predicted.valid) {
+    return full;
+  }
+
+  // the ball's last radius, scaled up by the margin, plus three sigma of position error
+  double radius = std::max(lastBall.bbox.width, lastBall.bbox.height) / 2;
+  double half = (s.roiMargin * radius + 3 * predicted.uncertainty) * s.imageScaling;
+  half = std::max(half, (double) minWindowHalfSize);
+
+  double cx = (predicted.position.x + 0.5) * s.imageScaling - 0.5;
+  double cy = (predicted.position.y + 0.5) * s.imageScaling - 0.5;
+  cv::Rect window((int) std::floor(cx - half), (int) std::floor(cy - half),
+                  (int) std::ceil(2*half) + 1, (int) std::ceil(2*half) + 1);
+  window &= full;
+  return window.area() > 0 ? window : full;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+int framePipeline::maskHalo(const struct pipelineSettings& s) {
+  // each erosion or dilation with the 3x3 kernel reaches one pixel further
+  int halo = 0;
+  for (size_t i = 0; i < s.profiles.size(); i++) {
+    halo = std::max(halo, s.profiles[i].erosions + s.profiles[i].dilations);
+  }
+  return halo;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void framePipeline::maskRegion(const cv::Mat& image, bool yuv, cv::Rect rect, const struct pipelineSettings& s,
+                               std::vector<bitMask>& masks, struct maskScratch& buffers, cv::Rect keep) {
+  size_t count = s.profiles.size();
+
+  // profiles whose table isn't ready yet (or all of them, without tables) share one
+  // HSV conversion in the fused kernel
+  std::vector<std::shared_ptr<const struct lutTable>>& tables = buffers.tables;
+  std::vector<size_t>& fused = buffers.fused;
+  tables.resize(count);
+  fused.clear();
+  buffers.fusedProfiles.clear();
+  for (size_t i = 0; i < count; i++) {
+    tables[i].reset();
+    if (s.classifier == "lut") {
+      tables[i] = luts[i]->tableFor(s.profiles[i], yuv);
+    }
+    if (!tables[i]) {
+      fused.push_back(i);
+      buffers.fusedProfiles.push_back(s.profiles[i]);
+    }
+  }
+
+  // each row is thresholded into a byte buffer the width of the image, left clear
+  // outside rect, and packed straight away
+  std::vector<std::vector<uchar>>& rows = buffers.rows;
+  rows.resize(count);
+  for (size_t i = 0; i < count; i++) {
+    rows[i].assign(image.cols, 0);
+  }
+  buffers.fusedRows.clear();
+  for (size_t i : fused) {
+    buffers.fusedRows.push_back(rows[i].data() + rect.x);
+  }
+  if (yuv && !fused.empty()) {
+    buffers.bgr.resize(3 * rect.width);
+  }
+  masks.resize(count);
+  for (size_t i = 0; i < count; i++) {
+    masks[i].create(rect.height, image.cols);
+  }
+
+  for (int y = 0; y < rect.height; y++) {
+    const uchar* pixels = image.ptr<uchar>(rect.y + y) + 3 * rect.x;
+    if (!fused.empty()) {
+      // the fused kernel only reads BGR; YUV tables classify the row as it is
+      const uchar* bgr = pixels;
+      if (yuv) {
+        yuvToBgrRow(pixels, buffers.bgr.data(), rect.width);
+        bgr = buffers.bgr.data();
+      }
+      hsvThresholdRowMulti(bgr, buffers.fusedRows.data(), rect.width, buffers.fusedProfiles.data(),
+                           (int) fused.size());
+    }
+    for (size_t i = 0; i < count; i++) {
+      if (tables[i]) {
+        maskLut::applyRow(*tables[i], pixels, rows[i].data() + rect.x, rect.width);
+      }
+      masks[i].packRow(y, rows[i].data());
+    }
+  }
+
+  // erode / dilate masks
+  for (size_t i = 0; i < count; i++) {
+    const struct thresholdSettings& profile = s.profiles[i];
+    if (profile.morphology == morphologyBox) {
+      masks[i].erodeBox(profile.erosions, profile.erosions);
+      masks[i].dilateBox(profile.dilations, profile.dilations);
+    }
+    else {
+      masks[i].erode(profile.erosions);
+      masks[i].dilate(profile.dilations);
+    }
+  }
+
+  // moments of the finished detection mask over the rows and columns kept, summed
+  // while this tile's rows are still in cache rather than in a pass of their own
+  buffers.moments = maskMoments();
+  if (keep.area() > 0) {
+    const bitMask* exclude = s.excludeProfile >= 0 && s.excludeProfile < (int) count ?
+      &masks[s.excludeProfile] : NULL;
+    for (int y = keep.y; y < keep.y + keep.height; y++) {
+      double n, sumX, sumXX;
+      masks[s.detectProfile].rowSums(y - rect.y, keep.x, keep.x + keep.width, exclude, n, sumX, sumXX);
+      buffers.moments.addRow(y, n, sumX, sumXX);
+    }
+  }
+
+  // don't keep a replaced table alive until the next frame
+  for (size_t i = 0; i < count; i++) {
+    tables[i].reset();
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void framePipeline::maskTiles(const cv::Mat& image, bool yuv, cv::Rect rect, const struct pipelineSettings& s,
+                              std::vector<bitMask>& masks, cv::Rect window, struct maskMoments* moments) {
+  size_t count = s.profiles.size();
+  if (s.classifier == "lut") {
+    while (luts.size() < count) {
+      luts.emplace_back(new maskLut());
+    }
+  }
+
+  int tiles = std::max(1, std::min(s.tiles, rect.height));
+  if ((int) scratch.size() < tiles) {
+    scratch.resize(tiles);
+  }
+  if (!moments || s.detectProfile < 0 || s.detectProfile >= (int) count) {
+    window = cv::Rect();
+  }
+  if (tiles == 1) {
+    maskRegion(image, yuv, rect, s, masks, scratch[0], window & rect);
+    if (moments) {
+      *moments = scratch[0].moments;
+    }
+    return;
+  }
+  // the pool follows the tiles setting rather than this region, so a small ROI
+  // just runs fewer tasks instead of respawning the threads
+  if (!pool || pool->size() != s.tiles) {
+    pool.reset(new threadPool(s.tiles));
+  }
+
+  masks.resize(count);
+  for (size_t i = 0; i < count; i++) {
+    masks[i].create(rect.height, image.cols);
+  }
+
+  // each tile is computed with halo rows above and below, which absorb the edge
+  // effects of the morphology, so the rows it keeps match the serial result exactly
+  int halo = maskHalo(s);
+  pool->run(tiles, [&](int t) {
+    int y0 = t * rect.height / tiles;
+    int y1 = (t+1) * rect.height / tiles;
+    int top = std::max(0, y0 - halo);
+    int bottom = std::min(rect.height, y1 + halo);
+
+    std::vector<bitMask>& tileMasks = scratch[t].masks;
+    cv::Rect kept(rect.x, rect.y + y0, rect.width, y1 - y0);
+    maskRegion(image, yuv, cv::Rect(rect.x, rect.y + top, rect.width, bottom - top), s, tileMasks, scratch[t],
+               window & kept);
+    for (size_t i = 0; i < count; i++) {
+      masks[i].copyRows(tileMasks[i], y0 - top, y0, y1 - y0);
+    }
+  });
+
+  if (moments) {
+    *moments = maskMoments();
+    for (int t = 0; t < tiles; t++) {
+      *moments += scratch[t].moments;
+    }
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void framePipeline::maskImage(const cv::Mat& image, const struct pipelineSettings& s,
+                              std::vector<bitMask>& masks, bool yuv) {
+  processMutex.lock();
+  maskTiles(image, yuv, cv::Rect(0, 0, image.cols, image.rows), s, masks, cv::Rect(), NULL);
+  processMutex.unlock();
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// one row through a profile's table, or the HSV kernel if there is none
+static void classifyRow(const uchar* pixels, bool yuv, const struct lutTable* table,
+                        const struct thresholdSettings& bounds, uchar* mask, int width, uchar* bgr) {
+  if (table) {
+    maskLut::applyRow(*table, pixels, mask, width);
+    return;
+  }
+  if (yuv) {
+    yuvToBgrRow(pixels, bgr, width);
+    pixels = bgr;
+  }
+  hsvThresholdRow(pixels, mask, width, bounds);
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+bool framePipeline::refineBall(const capturedFrame& frame, const struct pipelineSettings& s,
+                               const struct frameResult& r, struct ballState& ball) {
+  if (!ball.found || s.refineScaling <= s.imageScaling) {
+    return false;
+  }
+
+  // the ball's box and a margin, in full-resolution pixels, on even coordinates so
+  // no YUV chroma block is split
+  cv::Size size = frameSize(frame.image, frame.format);
+  double margin = refineMargin / s.imageScaling;
+  int x0 = (int) std::floor(ball.bbox.x - margin) & ~1;
+  int y0 = (int) std::floor(ball.bbox.y - margin) & ~1;
+  int x1 = (int) std::ceil(ball.bbox.x + ball.bbox.width + margin);
+  int y1 = (int) std::ceil(ball.bbox.y + ball.bbox.height + margin);
+  cv::Rect region(x0, y0, (x1 - x0 + 1) & ~1, (y1 - y0 + 1) & ~1);
+  region &= cv::Rect(0, 0, size.width & ~1, size.height & ~1);
+  if (region.area() == 0) {
+    return false;
+  }
+
+  // the window at the refinement scale: part of the pyramid's level if it was already
+  // made, e.g. at full size or as a larger preview, otherwise the region alone scaled
+  // into a buffer that only grows, since its size follows the ball. @c origin is where
+  // the window's first pixel starts in the frame
+  bool yuvFrame = frame.format != pixelBgr;
+  cv::Mat pixels;
+  cv::Point2f origin((float) region.x, (float) region.y);
+  cv::Mat level = r.pyramid.cached(s.refineScaling);
+  if (!level.empty()) {
+    int lx0 = (int) std::floor(region.x * s.refineScaling);
+    int ly0 = (int) std::floor(region.y * s.refineScaling);
+    int lx1 = (int) std::ceil((region.x + region.width) * s.refineScaling);
+    int ly1 = (int) std::ceil((region.y + region.height) * s.refineScaling);
+    cv::Rect scaledRegion = cv::Rect(lx0, ly0, lx1 - lx0, ly1 - ly0) & cv::Rect(0, 0, level.cols, level.rows);
+    if (scaledRegion.area() == 0) {
+      return false;
+    }
+    pixels = cv::Mat(level, scaledRegion);
+    origin = cv::Point2f((float) (scaledRegion.x / s.refineScaling), (float) (scaledRegion.y / s.refineScaling));
+  }
+  else {
+    cv::Size scaled(cvRound(region.width * s.refineScaling), cvRound(region.height * s.refineScaling));
+    pixels = reusableMat(refineBuffer, scaled, 3);
+    if (yuvFrame) {
+      scaleYuv(frame.image, frame.format, s.refineScaling, pixels, yuvPlanes, region);
+    }
+    else {
+      cv::resize(cv::Mat(frame.image, region), pixels, cv::Size(), s.refineScaling, s.refineScaling, cv::INTER_AREA);
+    }
+  }
+  if (pixels.cols == 0 || pixels.rows == 0) {
+    return false;
+  }
+
+  std::shared_ptr<const struct lutTable> table, excludeTable;
+  const struct thresholdSettings& bounds = s.profiles[s.detectProfile];
+  const struct thresholdSettings* excludeBounds = NULL;
+  if (s.excludeProfile >= 0 && s.excludeProfile < (int) s.profiles.size()) {
+    excludeBounds = &s.profiles[s.excludeProfile];
+  }
+  if (s.classifier == "lut") {
+    table = luts[s.detectProfile]->tableFor(bounds, yuvFrame);
+    if (excludeBounds) {
+      excludeTable = luts[s.excludeProfile]->tableFor(*excludeBounds, yuvFrame);
+    }
+  }
+
+  // pixels only count inside the coarse mask, which keeps out anything the morphology
+  // removed at the detection scale; each column's coarse pixel is looked up once
+  const bitMask& coarse = r.masks[s.detectProfile];
+  int width = pixels.cols;
+  refineRow.resize(width);
+  refineExcluded.resize(width);
+  refineBgr.resize(3 * width);
+  refineColumns.resize(width);
+  for (int x = 0; x < width; x++) {
+    int column = (int) ((origin.x + (x + 0.5) / s.refineScaling) * s.imageScaling);
+    refineColumns[x] = std::min(std::max(column, 0), coarse.cols() - 1);
+  }
+
+  struct maskMoments moments;
+  for (int y = 0; y < pixels.rows; y++) {
+    const uchar* row = pixels.ptr<uchar>(y);
+    classifyRow(row, yuvFrame, table.get(), bounds, refineRow.data(), width, refineBgr.data());
+    if (excludeBounds) {
+      classifyRow(row, yuvFrame, excludeTable.get(), *excludeBounds, refineExcluded.data(), width, refineBgr.data());
+    }
+    int coarseY = (int) ((origin.y + (y + 0.5) / s.refineScaling) * s.imageScaling);
+    coarseY = std::min(std::max(coarseY, 0), coarse.rows() - 1);
+
+    double count = 0, sumX = 0, sumXX = 0;
+    for (int x = 0; x < width; x++) {
+      if (refineRow[x] && !(excludeBounds && refineExcluded[x]) && coarse.at(coarseY, refineColumns[x])) {
+        count += 1;
+        sumX += x;
+        sumXX += (double) x * x;
+      }
+    }
+    moments.addRow(y, count, sumX, sumXX);
+  }
+
+  // keep the coarse ball if nothing survives at the finer scale; its confidence
+  // also weighs in the rest of the mask, so it is kept either way
+  struct ballState fine = detectBall(moments, s.refineScaling, s.detection);
+  if (!fine.found) {
+    return false;
+  }
+  ball.center = fine.center + origin;
+  ball.bbox = cv::Rect2f(fine.bbox.x + origin.x, fine.bbox.y + origin.y, fine.bbox.width, fine.bbox.height);
+  ball.area = fine.area;
+  ball.orientation = fine.orientation;
+  ball.axes = fine.axes;
+  return true;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+std::shared_ptr<struct frameResult> framePipeline::spareResult() {
+  // a result only this list still points to has no readers left, and can't get any,
+  // so it is overwritten in place and its image and masks keep their buffers. They are
+  // taken in turn so every one is sized during the warm-up
+  for (size_t n = 0; n < results.size(); n++) {
+    size_t i = (nextResult + n) % results.size();
+    if (results[i].use_count() == 1) {
+      nextResult = i + 1;
+      return results[i];
+    }
+  }
+  results.push_back(std::make_shared<struct frameResult>());
+  nextResult = 0;
+  return results.back();
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void framePipeline::checkAllocations(unsigned long allocations, const struct pipelineSettings& s,
+                                     cv::Size size) {
+  if (s.version != steadyVersion || size != steadySize) {
+    steadyVersion = s.version;
+    steadySize = size;
+    steadyFrames = 0;
+  }
+  steadyFrames++;
+
+  if (allocations > 0 && steadyFrames > warmupFrames) {
+    std::cerr << "error: frame allocated " << allocations << " times after " << steadyFrames - 1
+              << " frames with the same settings; the steady state must not allocate" << std::endl;
+    std::abort();
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+std::shared_ptr<const struct frameResult> framePipeline::compute(const capturedFrame& frame,
+                                                                 const struct pipelineSettings& s) {
+  unsigned long allocations = threadAllocations();
+  std::shared_ptr<struct frameResult> r = spareResult();
+  r->id = frame.id;
+  r->timestamp = frame.timestamp;
+  r->settings = s;
+
+  // YUV frames are scaled plane by plane and classified as YUV; only the scaled
+  // preview is converted to BGR. The masks' level is asked for first, so it is always
+  // scaled from the frame, and a smaller preview is shrunk from it
+  bool yuvFrame = frame.format != pixelBgr;
+  r->pyramid.assign(frame);
+  cv::Mat detection = r->pyramid.level(s.imageScaling);
+  r->image = r->pyramid.bgr(s.previewScaling);
+  r->maskSize = detection.size();
+
+  size_t count = s.profiles.size();
+  r->masks.resize(count);
+
+  // in ROI mode only a window around the predicted ball is processed, padded by one
+  // pixel per erosion and dilation so the morphology is exact inside the window
+  cv::Rect full(0, 0, r->maskSize.width, r->maskSize.height);
+  r->window = searchWindow(frame, s, r->maskSize);
+  int halo = maskHalo(s);
+  cv::Rect padded(r->window.x - halo, r->window.y - halo,
+                  r->window.width + 2*halo, r->window.height + 2*halo);
+  padded &= full;
+
+  bool useMoments = s.detection.method == "moments";
+  r->moments = maskMoments();
+  maskTiles(detection, yuvFrame, padded, s, work, r->window, useMoments ? &r->moments : NULL);
+
+  // the work masks are full width but only cover the padded rows; outside the window
+  // the masks are empty
+  for (size_t i = 0; i < count; i++) {
+    if (padded.height == full.height) {
+      std::swap(r->masks[i], work[i]);
+    }
+    else {
+      r->masks[i].create(full.height, full.width);
+      r->masks[i].copyRows(work[i], 0, padded.y, padded.height);
+    }
+    if (r->window != full) {
+      r->masks[i].keepRect(r->window);
+    }
+  }
+  r->processedFraction = (double) padded.area() / full.area();
+
+  if (s.detectProfile >= 0 && s.detectProfile < (int) count) {
+    const bitMask* exclude = NULL;
+    if (s.excludeProfile >= 0 && s.excludeProfile < (int) count) {
+      exclude = &r->masks[s.excludeProfile];
+    }
+    bool coarseToFine = !useMoments && s.refineCandidates > 1 && s.refineScaling > s.imageScaling;
+    if (useMoments) {
+      r->ball = detectBall(r->moments, s.imageScaling, s.detection);
+    }
+    else {
+      r->ball = detector.detect(r->masks[s.detectProfile], exclude, r->window, s.imageScaling, s.detection,
+                                coarseToFine ? s.refineCandidates : 0, coarseToFine ? &candidates : NULL);
+    }
+    if (coarseToFine) {
+      // at the detection scale the ball may be no larger than some other blob; each
+      // candidate is measured at the finer scale, and the largest there is the ball
+      r->refined = false;
+      double refinedArea = 0;
+      for (size_t i = 0; i < candidates.size(); i++) {
+        if (refineBall(frame, s, *r, candidates[i]) && candidates[i].area > refinedArea) {
+          refinedArea = candidates[i].area;
+          r->ball = candidates[i];
+          r->refined = true;
+        }
+      }
+    }
+    else {
+      r->refined = refineBall(frame, s, *r, r->ball);
+    }
+    tracker.update(r->ball, r->id, r->timestamp, s.tracking);
+    lastBall = r->ball;
+  }
+  else {
+    r->ball = ballState();
+    r->refined = false;
+  }
+
+  allocations = threadAllocations() - allocations;
+  if (allocationCounting()) {
+    checkAllocations(allocations, s, frameSize(frame.image, frame.format));
+  }
+
+  // running figures for /get/stats
+  statsMutex.lock();
+  stats.frames++;
+  if (r->window != full) {
+    stats.windowedFrames++;
+  }
+  stats.processedFraction = r->processedFraction;
+  stats.allocations = allocations;
+  stats.averageFraction += (r->processedFraction - stats.averageFraction) / std::min(stats.frames, statsWindow);
+  statsMutex.unlock();
+
+  return r;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
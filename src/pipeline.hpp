@@ -0,0 +1,381 @@
+/*! @file
+ * Defines the framePipeline class, which turns a captured frame into the scaled
+ * preview image and one mask per threshold profile, once per frame.
+ */
+
+#ifndef SMM_PIPELINE_HPP
+#define SMM_PIPELINE_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <mutex>
+
+#include <opencv2/core.hpp>
+
+#include "capture.hpp"
+#include "hsvThreshold.hpp"
+#include "maskLut.hpp"
+#include "pixelFormat.hpp"
+#include "framePyramid.hpp"
+#include "bitMask.hpp"
+#include "maskMoments.hpp"
+#include "ballDetector.hpp"
+#include "ballTracker.hpp"
+#include "threadPool.hpp"
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+/*! @brief Everything that decides what the pipeline produces for a frame. */
+struct pipelineSettings {
+  /*! @brief Bumped whenever any of the settings below change; results are cached by it. */
+  unsigned long version;
+
+  /*! @brief Scale factor applied to the captured frame before thresholding and detection. */
+  double imageScaling;
+
+  /*! @brief Scale factor of the preview image in each result. */
+  double previewScaling;
+
+  /*! @brief Scale factor the ball is measured again at, in a window around where
+   * detection found it. No refinement unless larger than @c imageScaling. */
+  double refineScaling;
+
+  /*! @brief With the @c "blobs" method, how many of the largest blobs at the detection
+   * scale are measured again at @c refineScaling; the largest there is the ball. 1
+   * refines only the largest blob at the detection scale. */
+  int refineCandidates;
+
+  /*! @brief How pixels are classified: @c "fused" or @c "lut". */
+  std::string classifier;
+
+  /*! @brief @c "full" to process every pixel, or @c "roi" to process only a window
+   * around the predicted ball while it is being tracked. */
+  std::string searchMode;
+
+  /*! @brief In ROI mode, the window's half-size in ball radii, before adding the
+   * tracker's uncertainty. */
+  double roiMargin;
+
+  /*! @brief Number of horizontal tiles the masks are computed in, each on its own
+   * thread; 1 computes them serially. */
+  int tiles;
+
+  /*! @brief One set of bounds and cleanup settings per mask. */
+  std::vector<struct thresholdSettings> profiles;
+
+  /*! @brief Index of the profile the ball is detected in, or -1 to skip detection. */
+  int detectProfile;
+
+  /*! @brief Index of the profile removed from the ball mask before detection, or -1. */
+  int excludeProfile;
+
+  /*! @brief Settings for the detection stage. */
+  struct detectionSettings detection;
+
+  /*! @brief Settings for the tracker fed by the detection stage. */
+  struct trackerSettings tracking;
+};
+
+/*! @brief Helper typedef for the function the processing thread gets its settings from.
+ *
+ * The function fills in the settings it is given rather than returning new ones, so
+ * the processing thread can reuse the same struct, and its profile vector, every frame. */
+typedef void (*settingsCallback_t)(struct pipelineSettings&, void*);
+
+/*! @brief Helper typedef for the function the processing thread calls with each new
+ * result, e.g. to push it to streaming clients. It runs on the processing thread, so
+ * it should return quickly. */
+typedef void (*resultCallback_t)(std::shared_ptr<const struct frameResult>, void*);
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+/*! @brief Running figures about the work the pipeline does. */
+struct pipelineStats {
+  /*! @brief Frames processed. */
+  unsigned long frames;
+
+  /*! @brief Frames where only a window around the ball was processed. */
+  unsigned long windowedFrames;
+
+  /*! @brief Share of pixels processed in the newest frame. */
+  double processedFraction;
+
+  /*! @brief Share of pixels processed, averaged over roughly the last 100 frames. */
+  double averageFraction;
+
+  /*! @brief Heap allocations made while processing the newest frame. Only counted in
+   * builds with @c SMM_COUNT_ALLOCATIONS; always 0 otherwise. */
+  unsigned long allocations;
+
+  pipelineStats() : frames(0), windowedFrames(0), processedFraction(0), averageFraction(0), allocations(0) {}
+};
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+/*! @brief The output of the pipeline for one frame. Never modified once published. */
+struct frameResult {
+  /*! @brief Id of the captured frame this was computed from. */
+  unsigned long id;
+
+  /*! @brief Capture time of that frame. */
+  frameClock::time_point timestamp;
+
+  /*! @brief The frame in BGR, scaled by @c settings.previewScaling, for display. A
+   * level of @c pyramid. */
+  cv::Mat image;
+
+  /*! @brief The frame and every scaled copy of it made so far. Readers may ask it for
+   * other sizes, e.g. thumbnails, which are computed on first request and then shared. */
+  mutable framePyramid pyramid;
+
+  /*! @brief One eroded and dilated mask per profile, in the order of @c settings.profiles,
+   * scaled by @c settings.imageScaling. Empty outside @c window. */
+  std::vector<bitMask> masks;
+
+  /*! @brief Size of the masks. */
+  cv::Size maskSize;
+
+  /*! @brief The part of @c image that was searched; all of it unless tracking in ROI mode. */
+  cv::Rect window;
+
+  /*! @brief Share of @c image's pixels that were thresholded, including the morphology halo. */
+  double processedFraction;
+
+  /*! @brief The detected ball, refined if @c settings.refineScaling asks for it; not
+   * found if detection is off. */
+  struct ballState ball;
+
+  /*! @brief @c True if @c ball was measured again at @c settings.refineScaling. */
+  bool refined;
+
+  /*! @brief With the @c "moments" detection method, the moments of the detection
+   * profile's mask inside @c window, less the excluded profile's pixels. Accumulated
+   * by the mask stage as it makes the masks; all zero with other methods. */
+  struct maskMoments moments;
+
+  /*! @brief The settings the result was computed with. */
+  struct pipelineSettings settings;
+};
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+/*! @brief Buffers one tile of the mask stage works in, kept from frame to frame. */
+struct maskScratch {
+  /*! @brief Per profile, the LUT in use, or empty for the fused kernel. */
+  std::vector<std::shared_ptr<const struct lutTable>> tables;
+
+  /*! @brief Indices and bounds of the profiles thresholded by the fused kernel. */
+  std::vector<size_t> fused;
+  std::vector<struct thresholdSettings> fusedProfiles;
+
+  /*! @brief Per profile, one thresholded row as bytes, and where the fused kernel writes it. */
+  std::vector<std::vector<uchar>> rows;
+  std::vector<uchar*> fusedRows;
+
+  /*! @brief A YUV row converted to BGR, for profiles the fused kernel thresholds. */
+  std::vector<uchar> bgr;
+
+  /*! @brief The tile's masks, before they are copied into the frame's. */
+  std::vector<bitMask> masks;
+
+  /*! @brief Moments of the rows of the detection mask the tile keeps. */
+  struct maskMoments moments;
+};
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+/*! @class framePipeline
+ * @brief Processes each captured frame at most once, however many masks are asked for.
+ *
+ * All profiles are thresholded in a single pass with hsvThresholdRowMulti(), so every
+ * pixel is converted to HSV once per frame rather than once per mask. Each row is
+ * packed into a bitMask as soon as it is thresholded, and the masks stay packed
+ * through morphology and detection. The result is kept until a new frame arrives or
+ * the settings version changes; callers that ask again in the meantime share the
+ * same result.
+ *
+ * Detection, refinement and the preview each have their own resolution. The masks are
+ * made at @c imageScaling. If @c refineScaling is finer, the ball is then thresholded
+ * again at that scale in a small window around it, within the coarse blob, for a more
+ * precise centroid and size. With @c refineCandidates above 1 the search becomes
+ * coarse to fine: the masks can be made at 1/4 or 1/8 scale, where the ball may be
+ * hard to tell from another blob, and the largest few blobs are all measured again,
+ * the largest at the finer scale being the ball. The preview is scaled for display alone. All of them
+ * come from the result's framePyramid, so a scale is computed once per frame however
+ * many use it: the preview is the masks' image when the scales match and is shrunk
+ * from it when smaller, and the refinement reads a level someone already made rather
+ * than scaling its window again.
+ *
+ * Frames captured in YUYV or NV12 are never converted to BGR at full resolution. The
+ * planes are scaled and unpacked to Y U V with scaleYuv(), the masks are classified
+ * from that through YUV tables, and only the scaled preview image is converted.
+ *
+ * Once launched, the pipeline also runs on its own thread for every captured frame,
+ * so the ball is detected at camera rate whether or not anyone is polling.
+ *
+ * Once the first frames have sized its buffers, processing a frame allocates nothing:
+ * results nobody holds any more are recycled, image and masks included, and every
+ * stage works in buffers kept from the previous frame. Builds with
+ * @c SMM_COUNT_ALLOCATIONS check this and abort if a frame allocates once the settings
+ * and frame size have been steady for a while.
+ */
+class framePipeline {
+private:
+  std::shared_ptr<const struct frameResult> compute(const capturedFrame& frame,
+                                                    const struct pipelineSettings& s);
+  void processLoop();
+  cv::Rect searchWindow(const capturedFrame& frame, const struct pipelineSettings& s, cv::Size size);
+  static int maskHalo(const struct pipelineSettings& s);
+  void maskRegion(const cv::Mat& image, bool yuv, cv::Rect rect, const struct pipelineSettings& s,
+                  std::vector<bitMask>& masks, struct maskScratch& buffers, cv::Rect keep);
+  void maskTiles(const cv::Mat& image, bool yuv, cv::Rect rect, const struct pipelineSettings& s,
+                 std::vector<bitMask>& masks, cv::Rect window, struct maskMoments* moments);
+  bool refineBall(const capturedFrame& frame, const struct pipelineSettings& s, const struct frameResult& r,
+                  struct ballState& ball);
+  std::shared_ptr<struct frameResult> spareResult();
+  void checkAllocations(unsigned long allocations, const struct pipelineSettings& s, cv::Size size);
+
+  std::thread thread;
+  std::atomic<bool> running;
+  captureThread* capture;
+  settingsCallback_t settingsCallback;
+  resultCallback_t resultCallback;
+  void* settingsData;
+
+  std::mutex processMutex;
+  capturedFrame input;
+  std::shared_ptr<const struct frameResult> result;
+  std::vector<std::unique_ptr<maskLut>> luts;
+  std::unique_ptr<threadPool> pool;
+  ballTracker tracker;
+  ballDetector detector;
+  struct ballState lastBall;
+
+  std::vector<std::shared_ptr<struct frameResult>> results;
+  size_t nextResult;
+  std::vector<struct maskScratch> scratch;
+  std::vector<bitMask> work;
+  struct yuvScratch yuvPlanes;
+
+  std::vector<uchar> refineBuffer;
+  std::vector<uchar> refineRow;
+  std::vector<uchar> refineExcluded;
+  std::vector<uchar> refineBgr;
+  std::vector<int> refineColumns;
+  std::vector<struct ballState> candidates;
+  unsigned long steadyVersion;
+  cv::Size steadySize;
+  unsigned long steadyFrames;
+
+  std::mutex statsMutex;
+  struct pipelineStats stats;
+
+public:
+  /*! @brief framePipeline constructor. */
+  framePipeline();
+
+  /*! @brief framePipeline destructor.
+   *
+   * The destructor stops the processing thread.
+   */
+  ~framePipeline();
+
+  /*! @brief Start processing every captured frame.
+   *
+   * @param capture The capture thread to take frames from.
+   * @param settings Called once per frame to get the settings to process with.
+   * @param data Pointer passed to @c settings and @c published.
+   * @param published Called with every result the thread computes, or @c NULL.
+   */
+  void launch(captureThread* capture, settingsCallback_t settings, void* data,
+              resultCallback_t published = NULL);
+
+  /*! @brief Stop the processing thread. */
+  void shutdown();
+
+  /*! @brief Returns the current state.
+   *
+   * @returns @c True if the processing thread is running; @c False otherwise.
+   */
+  bool isRunning();
+
+  /*! @brief Get the most recent result without computing anything.
+   *
+   * This is the in-process way to follow the ball: while the processing thread runs,
+   * it is at most one frame behind the camera.
+   *
+   * @returns The result, or an empty pointer if no frame has been processed yet.
+   */
+  std::shared_ptr<const struct frameResult> newest();
+
+  /*! @brief Predict where the ball is at a given time.
+   *
+   * Every detection the pipeline makes is fed to a ballTracker, so this can be asked
+   * for the position at the moment an output takes effect rather than when the
+   * newest frame was exposed.
+   *
+   * @param when The time to predict for.
+   *
+   * @returns The estimate; not valid if the ball was never found or has been lost.
+   */
+  struct trackedBall predictBall(frameClock::time_point when);
+
+  /*! @brief Forget the tracked ball, e.g. before replaying frames from the start. */
+  void resetTracker();
+
+  /*! @brief Get a copy of the running statistics. */
+  struct pipelineStats getStats();
+
+  /*! @brief Get the result for the newest captured frame.
+   *
+   * Computes it if the newest frame id or the settings version differ from the cached
+   * result; otherwise returns the cached result. Concurrent callers wait for a single
+   * computation rather than each doing their own.
+   *
+   * @param capture The capture thread to take the frame from.
+   * @param s The settings to process with.
+   *
+   * @returns The result, or an empty pointer if nothing has been captured yet.
+   */
+  std::shared_ptr<const struct frameResult> latest(captureThread& capture,
+                                                   const struct pipelineSettings& s);
+
+  /*! @brief Process a given frame, bypassing the cache.
+   *
+   * @param frame The frame to process.
+   * @param s The settings to process with.
+   *
+   * @returns The result.
+   */
+  std::shared_ptr<const struct frameResult> process(const capturedFrame& frame,
+                                                    const struct pipelineSettings& s);
+
+  /*! @brief Threshold and clean up an image, without detection or tracking.
+   *
+   * This is the mask stage of process() on its own, split into @c s.tiles tiles.
+   *
+   * @param image The 8-bit, 3-channel image, BGR or packed Y U V.
+   * @param s The settings to process with.
+   * @param masks Receives one mask per profile.
+   * @param yuv @c True if @c image holds Y U V, as from scaleYuv().
+   */
+  void maskImage(const cv::Mat& image, const struct pipelineSettings& s, std::vector<bitMask>& masks,
+                 bool yuv = false);
+
+  /*! @brief Build anything the settings need ahead of the first frame.
+   *
+   * With the @c "lut" classifier this compiles the tables on the calling thread, so
+   * no frame falls back to the fused kernel while they build.
+   *
+   * @param s The settings that will be used.
+   * @param format The pixelFormat frames will arrive in.
+   */
+  void prepare(const struct pipelineSettings& s, int format = pixelBgr);
+};
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#endif
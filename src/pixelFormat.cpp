@@ -0,0 +1,265 @@
+#include <algorithm>
+
+#include <opencv2/imgproc.hpp>
+
+#include "pixelFormat.hpp"
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// OpenCV's BT.601 YUV to RGB coefficients, scaled by 2^20
+static const int yuvShift = 20;
+static const int coefY  = 1220542;
+static const int coefUB = 2116026;
+static const int coefUG = -409993;
+static const int coefVG = -852492;
+static const int coefVR = 1673527;
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+bool parsePixelFormat(const std::string& name, int& format) {
+  if (name == "bgr") {
+    format = pixelBgr;
+  }
+  else if (name == "yuyv") {
+    format = pixelYuyv;
+  }
+  else if (name == "nv12") {
+    format = pixelNv12;
+  }
+  else {
+    return false;
+  }
+  return true;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+const char* pixelFormatName(int format) {
+  switch (format) {
+    case pixelYuyv: return "yuyv";
+    case pixelNv12: return "nv12";
+    default:        return "bgr";
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+cv::Size frameSize(const cv::Mat& frame, int format) {
+  if (format == pixelNv12) {
+    return cv::Size(frame.cols, frame.rows * 2 / 3);
+  }
+  return frame.size();
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+cv::Mat reusableMat(std::vector<uchar>& buffer, cv::Size size, int channels) {
+  size_t bytes = (size_t) size.area() * channels;
+  if (buffer.size() < bytes) {
+    buffer.resize(bytes);
+  }
+  return cv::Mat(size, CV_8UC(channels), buffer.data());
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void yuvToBgrRow(const uchar* yuv, uchar* bgr, int width) {
+  const int round = 1 << (yuvShift - 1);
+  for (int x = 0; x < width; x++, yuv += 3, bgr += 3) {
+    int y = std::max(0, yuv[0] - 16) * coefY + round;
+    int u = yuv[1] - 128;
+    int v = yuv[2] - 128;
+    bgr[0] = cv::saturate_cast<uchar>((y + coefUB * u) >> yuvShift);
+    bgr[1] = cv::saturate_cast<uchar>((y + coefUG * u + coefVG * v) >> yuvShift);
+    bgr[2] = cv::saturate_cast<uchar>((y + coefVR * v) >> yuvShift);
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void yuvToBgr(const cv::Mat& yuv, cv::Mat& bgr) {
+  CV_Assert(yuv.type() == CV_8UC3);
+  bgr.create(yuv.size(), CV_8UC3);
+  for (int y = 0; y < yuv.rows; y++) {
+    yuvToBgrRow(yuv.ptr<uchar>(y), bgr.ptr<uchar>(y), yuv.cols);
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// unpack at full resolution: each pixel gets its own Y and its block's U and V
+static void unpackYuv(const cv::Mat& frame, int format, int frameHeight, cv::Rect region, cv::Mat& yuv) {
+  for (int y = 0; y < region.height; y++) {
+    uchar* out = yuv.ptr<uchar>(y);
+    if (format == pixelYuyv) {
+      const uchar* in = frame.ptr<uchar>(region.y + y) + 2 * region.x;
+      for (int x = 0; x < region.width; x += 2, in += 4, out += 6) {
+        out[0] = in[0];
+        out[1] = in[1];
+        out[2] = in[3];
+        out[3] = in[2];
+        out[4] = in[1];
+        out[5] = in[3];
+      }
+    }
+    else {
+      const uchar* luma = frame.ptr<uchar>(region.y + y) + region.x;
+      const uchar* chroma = frame.ptr<uchar>(frameHeight + (region.y + y)/2) + region.x;
+      for (int x = 0; x < region.width; x += 2, luma += 2, chroma += 2, out += 6) {
+        out[0] = luma[0];
+        out[1] = chroma[0];
+        out[2] = chroma[1];
+        out[3] = luma[1];
+        out[4] = chroma[0];
+        out[5] = chroma[1];
+      }
+    }
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// area averaging when a plane shrinks both ways, as framePyramid shrinks BGR frames,
+// and linear interpolation when it grows, e.g. the chroma of NV12 above half size
+static int planeInterpolation(double fx, double fy) {
+  return fx <= 1 && fy <= 1 ? cv::INTER_AREA : cv::INTER_LINEAR;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void scaleYuv(const cv::Mat& frame, int format, double scaling, cv::Mat& yuv, struct yuvScratch& scratch,
+              cv::Rect region) {
+  CV_Assert((format == pixelYuyv && frame.type() == CV_8UC2) || (format == pixelNv12 && frame.type() == CV_8UC1));
+  cv::Size full = frameSize(frame, format);
+  if (region.area() == 0) {
+    region = cv::Rect(0, 0, full.width, full.height);
+  }
+  bool evenRows = format != pixelNv12 || (region.y % 2 == 0 && region.height % 2 == 0);
+  CV_Assert(region.x % 2 == 0 && region.width % 2 == 0 && evenRows);
+  CV_Assert(region.x + region.width <= full.width && region.y + region.height <= full.height);
+
+  cv::Size size = region.size();
+  cv::Size scaled(cvRound(size.width * scaling), cvRound(size.height * scaling));
+  yuv.create(scaled, CV_8UC3);
+  if (scaled == size) {
+    unpackYuv(frame, format, full.height, region, yuv);
+    return;
+  }
+
+  if (format == pixelYuyv) {
+    // each Y0 U Y1 V group is one 4-channel pixel at half the width; the two Ys of a
+    // scaled group are averaged into the pixel's Y
+    cv::Mat groups(size.height, size.width / 2, CV_8UC4, (void*) (frame.ptr<uchar>(region.y) + 2 * region.x),
+                   frame.step);
+    cv::Mat scaledGroups = reusableMat(scratch.luma, scaled, 4);
+    cv::resize(groups, scaledGroups, cv::Size(), 2 * scaling, scaling, planeInterpolation(2 * scaling, scaling));
+    for (int y = 0; y < scaled.height; y++) {
+      const uchar* in = scaledGroups.ptr<uchar>(y);
+      uchar* out = yuv.ptr<uchar>(y);
+      for (int x = 0; x < scaled.width; x++, in += 4, out += 3) {
+        out[0] = (in[0] + in[2] + 1) >> 1;
+        out[1] = in[1];
+        out[2] = in[3];
+      }
+    }
+    return;
+  }
+
+  // NV12: the Y plane, and the half-size U V plane, each scaled to the output size.
+  // The factors rather than the size are given, so every plane maps exactly as a
+  // cv::resize() of the whole frame would
+  cv::Mat luma(size.height, size.width, CV_8UC1, (void*) (frame.ptr<uchar>(region.y) + region.x), frame.step);
+  cv::Mat chroma(size.height / 2, size.width / 2, CV_8UC2,
+                 (void*) (frame.ptr<uchar>(full.height + region.y / 2) + region.x), frame.step);
+  cv::Mat scaledLuma = reusableMat(scratch.luma, scaled, 1);
+  cv::Mat scaledChroma = reusableMat(scratch.chroma, scaled, 2);
+  cv::resize(luma, scaledLuma, cv::Size(), scaling, scaling, planeInterpolation(scaling, scaling));
+  cv::resize(chroma, scaledChroma, cv::Size(), 2 * scaling, 2 * scaling, planeInterpolation(2 * scaling, 2 * scaling));
+  for (int y = 0; y < scaled.height; y++) {
+    const uchar* l = scaledLuma.ptr<uchar>(y);
+    const uchar* c = scaledChroma.ptr<uchar>(y);
+    uchar* out = yuv.ptr<uchar>(y);
+    for (int x = 0; x < scaled.width; x++, c += 2, out += 3) {
+      out[0] = l[x];
+      out[1] = c[0];
+      out[2] = c[1];
+    }
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void frameToBgr(const cv::Mat& frame, int format, cv::Mat& bgr) {
+  switch (format) {
+    case pixelYuyv:
+      cv::cvtColor(frame, bgr, cv::COLOR_YUV2BGR_YUYV);
+      break;
+    case pixelNv12:
+      cv::cvtColor(frame, bgr, cv::COLOR_YUV2BGR_NV12);
+      break;
+    default:
+      frame.copyTo(bgr);
+      break;
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// BT.601 limited range, in 8-bit fixed point
+static inline void bgrToYuvPixel(const uchar* p, int& y, int& u, int& v) {
+  int b = p[0], g = p[1], r = p[2];
+  y = ((66*r + 129*g + 25*b + 128) >> 8) + 16;
+  u = ((-38*r - 74*g + 112*b + 128) >> 8) + 128;
+  v = ((112*r - 94*g - 18*b + 128) >> 8) + 128;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void bgrToFrame(const cv::Mat& bgr, int format, cv::Mat& frame) {
+  CV_Assert(bgr.type() == CV_8UC3 && bgr.cols % 2 == 0);
+  if (format == pixelYuyv) {
+    frame.create(bgr.size(), CV_8UC2);
+    for (int y = 0; y < bgr.rows; y++) {
+      const uchar* in = bgr.ptr<uchar>(y);
+      uchar* out = frame.ptr<uchar>(y);
+      for (int x = 0; x < bgr.cols; x += 2, in += 6, out += 4) {
+        int y0, u0, v0, y1, u1, v1;
+        bgrToYuvPixel(in, y0, u0, v0);
+        bgrToYuvPixel(in + 3, y1, u1, v1);
+        out[0] = y0;
+        out[1] = (u0 + u1 + 1) >> 1;
+        out[2] = y1;
+        out[3] = (v0 + v1 + 1) >> 1;
+      }
+    }
+  }
+  else if (format == pixelNv12) {
+    CV_Assert(bgr.rows % 2 == 0);
+    frame.create(bgr.rows * 3 / 2, bgr.cols, CV_8UC1);
+    for (int y = 0; y < bgr.rows; y += 2) {
+      const uchar* top = bgr.ptr<uchar>(y);
+      const uchar* bottom = bgr.ptr<uchar>(y + 1);
+      uchar* lumaTop = frame.ptr<uchar>(y);
+      uchar* lumaBottom = frame.ptr<uchar>(y + 1);
+      uchar* chroma = frame.ptr<uchar>(bgr.rows + y/2);
+      for (int x = 0; x < bgr.cols; x += 2) {
+        int luma[4], u[4], v[4];
+        bgrToYuvPixel(top + 3*x,        luma[0], u[0], v[0]);
+        bgrToYuvPixel(top + 3*x + 3,    luma[1], u[1], v[1]);
+        bgrToYuvPixel(bottom + 3*x,     luma[2], u[2], v[2]);
+        bgrToYuvPixel(bottom + 3*x + 3, luma[3], u[3], v[3]);
+        lumaTop[x]        = luma[0];
+        lumaTop[x + 1]    = luma[1];
+        lumaBottom[x]     = luma[2];
+        lumaBottom[x + 1] = luma[3];
+        chroma[x]     = (u[0] + u[1] + u[2] + u[3] + 2) >> 2;
+        chroma[x + 1] = (v[0] + v[1] + v[2] + v[3] + 2) >> 2;
+      }
+    }
+  }
+  else {
+    bgr.copyTo(frame);
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
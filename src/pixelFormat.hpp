@@ -0,0 +1,122 @@
+/*! @file
+ * Defines the pixel formats frames can be captured in, and the conversions between
+ * a camera's native YUV layouts and the packed images the mask stage reads.
+ *
+ * YUV is taken to be BT.601 with limited range, as cameras deliver it; the YUV to
+ * BGR conversion here uses OpenCV's fixed-point coefficients and rounding, so it
+ * gives exactly the pixels cv::cvtColor() does.
+ */
+
+#ifndef SMM_PIXEL_FORMAT_HPP
+#define SMM_PIXEL_FORMAT_HPP
+
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+/*! @brief Layout of a captured frame's pixels. */
+enum pixelFormat {
+  /*! @brief 8-bit, 3-channel BGR. */
+  pixelBgr = 0,
+
+  /*! @brief 4:2:2 YUV as Y0 U Y1 V, in an 8-bit, 2-channel Mat of the frame's size. */
+  pixelYuyv = 1,
+
+  /*! @brief 4:2:0 YUV: a plane of Y, then one of interleaved U V at half the width and
+   * height, in an 8-bit, 1-channel Mat 3/2 times the frame's height. */
+  pixelNv12 = 2
+};
+
+/*! @brief Scratch planes for scaleYuv(), kept from frame to frame. They only grow, so
+ * regions whose size changes every frame stop allocating once the largest is seen. */
+struct yuvScratch {
+  std::vector<uchar> luma;
+  std::vector<uchar> chroma;
+};
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+/*! @brief Get a pixelFormat from its settings name: @c "bgr", @c "yuyv" or @c "nv12".
+ *
+ * @param name The name.
+ * @param format Receives the format; untouched if the name is unknown.
+ *
+ * @returns @c True if the name is known.
+ */
+bool parsePixelFormat(const std::string& name, int& format);
+
+/*! @brief Returns the settings name of a pixelFormat. */
+const char* pixelFormatName(int format);
+
+/*! @brief Returns the size in pixels of a frame stored in some format. */
+cv::Size frameSize(const cv::Mat& frame, int format);
+
+/*! @brief Get an 8-bit Mat whose pixels live in a buffer that only grows.
+ *
+ * OpenCV reallocates a Mat whenever its size changes. Images whose size varies from
+ * frame to frame, such as a window around the ball, use this instead so they only
+ * allocate when they are larger than ever before.
+ *
+ * @param buffer The buffer; grown if it is too small.
+ * @param size The image size.
+ * @param channels Number of channels.
+ *
+ * @returns A Mat over @c buffer, valid until the buffer next grows.
+ */
+cv::Mat reusableMat(std::vector<uchar>& buffer, cv::Size size, int channels);
+
+/*! @brief Convert a row of packed Y U V pixels to BGR.
+ *
+ * @param yuv Pointer to @c width pixels of three bytes each, Y first.
+ * @param bgr Pointer to @c width output BGR pixels.
+ * @param width Number of pixels in the row.
+ */
+void yuvToBgrRow(const uchar* yuv, uchar* bgr, int width);
+
+/*! @brief Convert packed Y U V pixels to BGR.
+ *
+ * @param yuv The 8-bit, 3-channel image, Y in the first channel.
+ * @param bgr Receives the BGR image. Its buffer is reused when the size matches.
+ */
+void yuvToBgr(const cv::Mat& yuv, cv::Mat& bgr);
+
+/*! @brief Scale a YUYV or NV12 frame, or part of one, and unpack it to one Y U V
+ * triple per pixel.
+ *
+ * The planes are scaled separately, so the full-resolution frame is read once and
+ * never converted to BGR. They are shrunk with area averaging, as framePyramid
+ * shrinks BGR frames, and grown with linear interpolation. Without scaling every
+ * pixel gets its own Y and the U V of the 2x1 or 2x2 block it belongs to, exactly
+ * the samples cv::cvtColor() converts.
+ *
+ * @param frame The frame.
+ * @param format Its format, pixelYuyv or pixelNv12.
+ * @param scaling Scale factor, as for cv::resize().
+ * @param yuv Receives the 8-bit, 3-channel packed image. Its buffer is reused when the size matches.
+ * @param scratch Buffers for the scaled planes.
+ * @param region The part of the frame to scale, or an empty rectangle for all of it.
+ * Its corners must fall on chroma block boundaries, i.e. be even.
+ */
+void scaleYuv(const cv::Mat& frame, int format, double scaling, cv::Mat& yuv, struct yuvScratch& scratch,
+              cv::Rect region = cv::Rect());
+
+/*! @brief Convert a frame in any format to BGR, with cv::cvtColor(). */
+void frameToBgr(const cv::Mat& frame, int format, cv::Mat& bgr);
+
+/*! @brief Convert a BGR image to YUYV or NV12, as a camera would deliver it.
+ *
+ * Chroma is averaged over each 2x1 or 2x2 block. Used to feed YUV frames from
+ * sources that render or decode BGR.
+ *
+ * @param bgr The 8-bit, 3-channel BGR image, with even width (and height, for NV12).
+ * @param format pixelYuyv or pixelNv12.
+ * @param frame Receives the frame. Its buffer is reused when the size matches.
+ */
+void bgrToFrame(const cv::Mat& bgr, int format, cv::Mat& frame);
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#endif
@@ -0,0 +1,432 @@
+#include <algorithm>
+
+#include "runMask.hpp"
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// largest mask deserialize() accepts, in pixels
+static const unsigned long maxPixels = 1UL << 28;
+
+// bits [from, to) of a word, 0 <= from <= to <= 64
+static uint64_t bitRange(int from, int to) {
+  uint64_t high = to >= 64 ? ~(uint64_t) 0 : ((uint64_t) 1 << to) - 1;
+  uint64_t low = ((uint64_t) 1 << from) - 1;
+  return high & ~low;
+}
+
+// index of the lowest set bit; w must not be 0
+static inline int lowestBit(uint64_t w) {
+#if defined(__GNUC__)
+  return __builtin_ctzll(w);
+#else
+  int n = 0;
+  while (!(w & 1)) {
+    w >>= 1;
+    n++;
+  }
+  return n;
+#endif
+}
+
+// appends a run, joining it to the previous one in the row if they touch
+static void addRun(std::vector<struct maskRun>& runs, size_t rowBegin, int start, int end) {
+  if (runs.size() > rowBegin && runs.back().end >= start) {
+    runs.back().end = std::max(runs.back().end, end);
+  }
+  else {
+    runs.push_back(maskRun{start, end});
+  }
+}
+
+static void writeVarint(std::string& out, unsigned long value) {
+  while (value >= 0x80) {
+    out.push_back((char) ((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  out.push_back((char) value);
+}
+
+static bool readVarint(const std::string& in, size_t& pos, unsigned long& value) {
+  value = 0;
+  for (int shift = 0; shift < 64 && pos < in.size(); shift += 7) {
+    unsigned char byte = in[pos++];
+    value |= (unsigned long) (byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+runMask::runMask() :
+  height(0),
+  width(0),
+  runs(),
+  rowStart(1, 0),
+  parent(),
+  label(),
+  sums() {}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void runMask::reset(int cols) {
+  height = 0;
+  width = cols;
+  runs.clear();
+  rowStart.assign(1, 0);
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void runMask::appendRow(const uchar* mask) {
+  int x = 0;
+  while (x < width) {
+    while (x < width && !mask[x]) {
+      x++;
+    }
+    int start = x;
+    while (x < width && mask[x]) {
+      x++;
+    }
+    if (x > start) {
+      runs.push_back(maskRun{start, x});
+    }
+  }
+  rowStart.push_back((int) runs.size());
+  height++;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+runMask runMask::fromBitMask(const bitMask& mask, cv::Rect rect, const bitMask* exclude) {
+  runMask m;
+  m.assign(mask, rect, exclude);
+  return m;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void runMask::assign(const bitMask& mask, cv::Rect rect, const bitMask* exclude) {
+  CV_Assert(rect.x >= 0 && rect.y >= 0 && rect.x + rect.width <= mask.cols() && rect.y + rect.height <= mask.rows());
+  CV_Assert(!exclude || (exclude->rows() == mask.rows() && exclude->cols() == mask.cols()));
+
+  reset(rect.width);
+  if (rect.width <= 0) {
+    return;
+  }
+
+  int x0 = rect.x, x1 = rect.x + rect.width;
+  for (int y = rect.y; y < rect.y + rect.height; y++) {
+    const uint64_t* r = mask.row(y);
+    const uint64_t* e = exclude ? exclude->row(y) : NULL;
+    size_t begin = runs.size();
+
+    for (int j = x0 >> 6; j <= (x1 - 1) >> 6; j++) {
+      uint64_t w = r[j];
+      if (e) {
+        w &= ~e[j];
+      }
+      w &= bitRange(std::max(x0 - 64*j, 0), std::min(x1 - 64*j, 64));
+
+      // peel off one run of ones at a time
+      while (w) {
+        int start = lowestBit(w);
+        uint64_t filled = w | (((uint64_t) 1 << start) - 1);
+        int end = ~filled ? lowestBit(~filled) : 64;
+        addRun(runs, begin, 64*j + start - x0, 64*j + end - x0);
+        w = end == 64 ? 0 : w & ~(((uint64_t) 1 << end) - 1);
+      }
+    }
+    rowStart.push_back((int) runs.size());
+    height++;
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void runMask::toBitMask(bitMask& mask) const {
+  mask.create(height, width);
+  for (int y = 0; y < height; y++) {
+    uint64_t* r = mask.row(y);
+    for (const struct maskRun* run = rowBegin(y); run != rowEnd(y); run++) {
+      for (int j = run->start >> 6; j <= (run->end - 1) >> 6; j++) {
+        r[j] |= bitRange(std::max(run->start - 64*j, 0), std::min(run->end - 64*j, 64));
+      }
+    }
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void runMask::morphStep(bool erode) {
+  // runs are maximal, so a 3x3 erosion shrinks each run by a pixel at both ends and
+  // intersects three rows, and a dilation grows each run and unites three rows. Past
+  // the edges counts as set for erosion and clear for dilation, like cv::erode() and
+  // cv::dilate() with their default border
+  std::vector<struct maskRun> out;
+  std::vector<int> outStart(1, 0);
+  std::vector<struct maskRun> rowRuns[3];
+  std::vector<struct maskRun> merged;
+
+  for (int y = 0; y < height; y++) {
+    for (int k = 0; k < 3; k++) {
+      int ry = y + k - 1;
+      std::vector<struct maskRun>& adjusted = rowRuns[k];
+      adjusted.clear();
+      if (ry < 0 || ry >= height) {
+        if (erode && width > 0) {
+          adjusted.push_back(maskRun{0, width});
+        }
+        continue;
+      }
+      for (const struct maskRun* run = rowBegin(ry); run != rowEnd(ry); run++) {
+        struct maskRun r = *run;
+        if (erode) {
+          r.start = r.start == 0 ? 0 : r.start + 1;
+          r.end = r.end == width ? width : r.end - 1;
+        }
+        else {
+          r.start = std::max(r.start - 1, 0);
+          r.end = std::min(r.end + 1, width);
+        }
+        if (r.start < r.end) {
+          adjusted.push_back(r);
+        }
+      }
+    }
+
+    size_t begin = out.size();
+    if (erode) {
+      // intersect the rows pairwise with two cursors each
+      merged.clear();
+      size_t i = 0, j = 0;
+      while (i < rowRuns[0].size() && j < rowRuns[1].size()) {
+        int start = std::max(rowRuns[0][i].start, rowRuns[1][j].start);
+        int end = std::min(rowRuns[0][i].end, rowRuns[1][j].end);
+        if (start < end) {
+          merged.push_back(maskRun{start, end});
+        }
+        if (rowRuns[0][i].end < rowRuns[1][j].end) {
+          i++;
+        }
+        else {
+          j++;
+        }
+      }
+      i = j = 0;
+      while (i < merged.size() && j < rowRuns[2].size()) {
+        int start = std::max(merged[i].start, rowRuns[2][j].start);
+        int end = std::min(merged[i].end, rowRuns[2][j].end);
+        if (start < end) {
+          out.push_back(maskRun{start, end});
+        }
+        if (merged[i].end < rowRuns[2][j].end) {
+          i++;
+        }
+        else {
+          j++;
+        }
+      }
+    }
+    else {
+      // unite the rows by always taking the run that starts first
+      size_t i[3] = {0, 0, 0};
+      while (true) {
+        int k = -1;
+        for (int n = 0; n < 3; n++) {
+          if (i[n] < rowRuns[n].size() && (k < 0 || rowRuns[n][i[n]].start < rowRuns[k][i[k]].start)) {
+            k = n;
+          }
+        }
+        if (k < 0) {
+          break;
+        }
+        const struct maskRun& r = rowRuns[k][i[k]++];
+        addRun(out, begin, r.start, r.end);
+      }
+    }
+    outStart.push_back((int) out.size());
+  }
+
+  runs.swap(out);
+  rowStart.swap(outStart);
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void runMask::erode(int iterations) {
+  for (int i = 0; i < iterations; i++) {
+    morphStep(true);
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void runMask::dilate(int iterations) {
+  for (int i = 0; i < iterations; i++) {
+    morphStep(false);
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+long runMask::count() const {
+  long n = 0;
+  for (const struct maskRun& r : runs) {
+    n += r.end - r.start;
+  }
+  return n;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+std::vector<struct maskBlob> runMask::blobs() const {
+  std::vector<struct maskBlob> b;
+  blobs(b);
+  return b;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void runMask::blobs(std::vector<struct maskBlob>& blobs) const {
+  // union-find over runs; runs in neighbouring rows join when they overlap or touch
+  // diagonally
+  parent.resize(runs.size());
+  for (size_t i = 0; i < parent.size(); i++) {
+    parent[i] = (int) i;
+  }
+  auto find = [this](int i) {
+    while (parent[i] != i) {
+      parent[i] = parent[parent[i]];
+      i = parent[i];
+    }
+    return i;
+  };
+
+  for (int y = 1; y < height; y++) {
+    int i = rowStart[y - 1], j = rowStart[y];
+    while (i < rowStart[y] && j < rowStart[y + 1]) {
+      if (runs[i].start <= runs[j].end && runs[j].start <= runs[i].end) {
+        int a = find(i), b = find(j);
+        if (a != b) {
+          // the root is always the earliest run, so blobs come out in raster order
+          parent[std::max(a, b)] = std::min(a, b);
+        }
+      }
+      if (runs[i].end < runs[j].end) {
+        i++;
+      }
+      else {
+        j++;
+      }
+    }
+  }
+
+  blobs.clear();
+  sums.clear();
+  label.assign(runs.size(), -1);
+  for (int y = 0; y < height; y++) {
+    for (int k = rowStart[y]; k < rowStart[y + 1]; k++) {
+      int root = find(k);
+      if (label[root] < 0) {
+        label[root] = (int) blobs.size();
+        blobs.push_back(maskBlob());
+        blobs.back().area = 0;
+        sums.push_back(blobSums{maskMoments(), cv::Point(runs[k].start, y), cv::Point(runs[k].end, y + 1)});
+      }
+      int b = label[root];
+      long length = runs[k].end - runs[k].start;
+      struct blobSums& sum = sums[b];
+      blobs[b].area += length;
+      sum.moments.addRun(y, runs[k].start, runs[k].end);
+      sum.low.x = std::min(sum.low.x, runs[k].start);
+      sum.high.x = std::max(sum.high.x, runs[k].end);
+      sum.high.y = y + 1;
+    }
+  }
+
+  for (size_t b = 0; b < blobs.size(); b++) {
+    const struct blobSums& sum = sums[b];
+    blobs[b].centroid = sum.moments.centroid();
+    blobs[b].bbox = cv::Rect(sum.low.x, sum.low.y, sum.high.x - sum.low.x, sum.high.y - sum.low.y);
+    blobs[b].moments = sum.moments;
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void runMask::serialize(std::string& encoded) const {
+  encoded.clear();
+  writeVarint(encoded, width);
+  writeVarint(encoded, height);
+  writeVarint(encoded, runs.size());
+
+  unsigned long last = 0;
+  for (int y = 0; y < height; y++) {
+    unsigned long row = (unsigned long) y * width;
+    for (const struct maskRun* run = rowBegin(y); run != rowEnd(y); run++) {
+      writeVarint(encoded, row + run->start - last);
+      writeVarint(encoded, run->end - run->start);
+      last = row + run->end;
+    }
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+bool runMask::deserialize(const std::string& encoded) {
+  reset(0);
+
+  size_t pos = 0;
+  unsigned long cols, rows, count;
+  if (!readVarint(encoded, pos, cols) || !readVarint(encoded, pos, rows) ||
+      !readVarint(encoded, pos, count)) {
+    return false;
+  }
+  // check each side before multiplying so a huge header can't wrap the product
+  if (cols == 0 || rows == 0 || cols > maxPixels || rows > maxPixels / cols) {
+    return false;
+  }
+  unsigned long pixels = cols * rows;
+  if (count > pixels) {
+    return false;
+  }
+
+  width = (int) cols;
+  unsigned long last = 0;
+  for (unsigned long i = 0; i < count; i++) {
+    unsigned long gap, length;
+    if (!readVarint(encoded, pos, gap) || !readVarint(encoded, pos, length) || length == 0 ||
+        gap > pixels - last || length > pixels - last - gap) {
+      reset(0);
+      return false;
+    }
+    unsigned long start = last + gap;
+    unsigned long end = start + length;
+    unsigned long y = start / cols;
+    // runs stay inside one row and never touch the previous run in that row
+    if ((end - 1) / cols != y || (i > 0 && gap == 0 && start % cols != 0)) {
+      reset(0);
+      return false;
+    }
+    while ((unsigned long) height < y) {
+      rowStart.push_back((int) runs.size());
+      height++;
+    }
+    runs.push_back(maskRun{(int) (start - y * cols), (int) (end - y * cols)});
+    last = end;
+  }
+  while ((unsigned long) height < rows) {
+    rowStart.push_back((int) runs.size());
+    height++;
+  }
+  if (pos != encoded.size()) {
+    reset(0);
+    return false;
+  }
+  return true;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
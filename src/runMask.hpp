@@ -0,0 +1,180 @@
+/*! @file
+ * Defines the runMask class, a binary mask stored as runs of set pixels per row.
+ */
+
+#ifndef SMM_RUN_MASK_HPP
+#define SMM_RUN_MASK_HPP
+
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "bitMask.hpp"
+#include "maskMoments.hpp"
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+/*! @brief A run of set pixels, columns @c start to <tt>end-1</tt> of one row. */
+struct maskRun {
+  int start;
+  int end;
+};
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+/*! @brief One 8-connected blob of a runMask. */
+struct maskBlob {
+  /*! @brief Number of pixels. */
+  long area;
+
+  /*! @brief Centroid of the pixels. */
+  cv::Point2d centroid;
+
+  /*! @brief Bounding box. */
+  cv::Rect bbox;
+
+  /*! @brief Raw moments up to second order, for the blob's orientation and axes. */
+  struct maskMoments moments;
+};
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+/*! @class runMask
+ * @brief A binary mask stored as sorted, non-touching runs per row.
+ *
+ * Memory and the cost of every operation grow with the number of runs rather than
+ * the number of pixels, which suits masks that are mostly empty. Rows are appended
+ * in order with appendRow() or copied from a bitMask with fromBitMask().
+ *
+ * erode() and dilate() give exactly the same result as cv::erode() and cv::dilate()
+ * with the default 3x3 kernel and border. blobs() finds the same 8-connected
+ * components as cv::connectedComponentsWithStats(), with the same areas, centroids
+ * and bounding boxes, by joining overlapping runs of neighbouring rows.
+ */
+class runMask {
+private:
+  void morphStep(bool erode);
+
+  // running sums for one blob while labeling
+  struct blobSums {
+    struct maskMoments moments;
+    cv::Point low;
+    cv::Point high;
+  };
+
+  int height;
+  int width;
+  std::vector<struct maskRun> runs;
+  std::vector<int> rowStart;
+
+  // kept between calls to blobs(), so labeling again doesn't allocate
+  mutable std::vector<int> parent;
+  mutable std::vector<int> label;
+  mutable std::vector<struct blobSums> sums;
+
+public:
+  /*! @brief Construct an empty mask with no rows. */
+  runMask();
+
+  /*! @brief Clear the mask and set its size. Rows are then appended one by one.
+   *
+   * @param cols Width in pixels.
+   */
+  void reset(int cols);
+
+  /*! @brief Returns the height in pixels, i.e. the number of rows appended. */
+  int rows() const { return height; }
+
+  /*! @brief Returns the width in pixels. */
+  int cols() const { return width; }
+
+  /*! @brief Returns the total number of runs. */
+  size_t runCount() const { return runs.size(); }
+
+  /*! @brief Returns a pointer to the first run of a row. */
+  const struct maskRun* rowBegin(int y) const { return runs.data() + rowStart[y]; }
+
+  /*! @brief Returns a pointer past the last run of a row. */
+  const struct maskRun* rowEnd(int y) const { return runs.data() + rowStart[y + 1]; }
+
+  /*! @brief Append a row of bytes; any nonzero byte sets its pixel.
+   *
+   * @param mask Pointer to @c cols() bytes.
+   */
+  void appendRow(const uchar* mask);
+
+  /*! @brief Get the runs of part of a packed mask.
+   *
+   * Empty words are skipped, so sparse masks convert in time proportional to their
+   * size in words plus their number of runs.
+   *
+   * @param mask The packed mask.
+   * @param rect The part to convert; the result is @c rect's size, at its origin.
+   * @param exclude If not @c NULL, a mask of the same size whose set pixels are left out.
+   *
+   * @returns The runs.
+   */
+  static runMask fromBitMask(const bitMask& mask, cv::Rect rect, const bitMask* exclude = NULL);
+
+  /*! @brief Replace the runs with those of part of a packed mask, like fromBitMask().
+   *
+   * The buffers are kept, so converting masks frame after frame only allocates when
+   * a mask has more runs than any before it.
+   *
+   * @param mask The packed mask.
+   * @param rect The part to convert; the result is @c rect's size, at its origin.
+   * @param exclude If not @c NULL, a mask of the same size whose set pixels are left out.
+   */
+  void assign(const bitMask& mask, cv::Rect rect, const bitMask* exclude = NULL);
+
+  /*! @brief Write the runs into a packed mask.
+   *
+   * @param mask Receives the mask. Its buffer is reused when it is large enough.
+   */
+  void toBitMask(bitMask& mask) const;
+
+  /*! @brief Erode with a 3x3 square, like cv::erode() with @c iterations. */
+  void erode(int iterations);
+
+  /*! @brief Dilate with a 3x3 square, like cv::dilate() with @c iterations. */
+  void dilate(int iterations);
+
+  /*! @brief Returns the number of set pixels. */
+  long count() const;
+
+  /*! @brief Label the 8-connected blobs.
+   *
+   * @returns One entry per blob, ordered by the first pixel of each in raster order.
+   */
+  std::vector<struct maskBlob> blobs() const;
+
+  /*! @brief Label the 8-connected blobs into an existing vector.
+   *
+   * @param blobs Receives one entry per blob, as from blobs(). Its buffer is reused.
+   */
+  void blobs(std::vector<struct maskBlob>& blobs) const;
+
+  /*! @brief Serialize to the compact binary format.
+   *
+   * The format is a sequence of unsigned LEB128 varints: width, height, number of
+   * runs, then for each run in raster order its gap from the end of the previous
+   * run and its length. Positions count along the rows as if the mask were one long
+   * line, starting at 0.
+   *
+   * @param encoded Receives the bytes.
+   */
+  void serialize(std::string& encoded) const;
+
+  /*! @brief Read a mask written by serialize().
+   *
+   * @param encoded The bytes.
+   *
+   * @returns @c False if the bytes are not a valid mask, in which case the mask is empty.
+   */
+  bool deserialize(const std::string& encoded);
+};
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#endif
@@ -1,9 +1,107 @@
+#include <algorithm>
 #include <ctime>
+#include <deque>
 
 #include "smmServer.hpp"
 
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
+// boundary between the parts of a stream
+static const char streamBoundary[] = "smmframe";
+
+// marks a connection as a stream; its user_data then points to a pushConnection
+static const unsigned long streamFlag = MG_F_USER_1;
+
+// marks a WebSocket connection on /ws; its user_data then points to a pushConnection
+static const unsigned long socketFlag = MG_F_USER_2;
+
+// queued bytes are copied to a connection's send buffer this much at a time
+static const size_t sendChunk = 16384;
+
+// one stream a connection receives
+struct streamConnection {
+  std::string name;
+  std::string mimeType;
+  streamCallback_t callback;
+  unsigned long id;
+};
+
+// bytes waiting to be sent; parts are shared by every connection sending them
+struct outgoingBytes {
+  std::shared_ptr<const std::string> bytes;
+  size_t sent;
+};
+
+// the state of a streaming connection: its one stream, or the streams a WebSocket
+// connection subscribed to, and what it has yet to send
+struct pushConnection {
+  std::vector<struct streamConnection> streams;
+  std::deque<struct outgoingBytes> outgoing;
+};
+
+// parts of these types go out as text messages, all others as binary ones
+static bool isTextType(const std::string& mimeType) {
+  return mimeType.compare(0, 5, "text/") == 0 || mimeType == "application/json";
+}
+
+// tops the send buffer up from the queue; called again on every MG_EV_SEND, so a
+// connection holds at most a chunk of its own copy of a part
+static void feedConnection(struct mg_connection* connection) {
+  struct pushConnection* push = (struct pushConnection*) connection->user_data;
+  while (connection->send_mbuf.len < sendChunk && !push->outgoing.empty()) {
+    struct outgoingBytes& front = push->outgoing.front();
+    size_t length = std::min(sendChunk, front.bytes->size() - front.sent);
+    mg_send(connection, front.bytes->data() + front.sent, (int) length);
+    front.sent += length;
+    if (front.sent == front.bytes->size()) {
+      push->outgoing.pop_front();
+    }
+  }
+}
+
+static void queueBytes(struct mg_connection* connection, std::shared_ptr<const std::string> bytes) {
+  struct pushConnection* push = (struct pushConnection*) connection->user_data;
+  struct outgoingBytes queued;
+  queued.bytes = bytes;
+  queued.sent = 0;
+  push->outgoing.push_back(queued);
+}
+
+// whether the connection is still sending something
+static bool isBacklogged(struct mg_connection* connection) {
+  struct pushConnection* push = (struct pushConnection*) connection->user_data;
+  return connection->send_mbuf.len > 0 || !push->outgoing.empty();
+}
+
+// queues a WebSocket message of the stream's name, a newline and the part; the frame
+// header is written here rather than by mongoose so the part needn't be copied
+static void queueSocketMessage(struct mg_connection* connection, int op,
+                               const std::string& name, std::shared_ptr<const std::string> part) {
+  size_t length = name.size() + 1 + part->size();
+  std::shared_ptr<std::string> head = std::make_shared<std::string>();
+  head->push_back((char) (0x80 | op));
+  if (length < 126) {
+    head->push_back((char) length);
+  }
+  else if (length < 65536) {
+    head->push_back((char) 126);
+    head->push_back((char) (length >> 8));
+    head->push_back((char) length);
+  }
+  else {
+    head->push_back((char) 127);
+    for (int shift = 56; shift >= 0; shift -= 8) {
+      head->push_back((char) ((unsigned long long) length >> shift));
+    }
+  }
+  *head += name;
+  head->push_back('\n');
+  queueBytes(connection, head);
+  queueBytes(connection, part);
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
 const char dayName[][4] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
 const char monthName[][4] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
 
@@ -32,6 +130,9 @@ smmServer::smmServer(std::string port,
   running(false),
   postCallbackMap(),
   getCallbackMap(),
+  streamCallbackMap(),
+  polling(false),
+  streamCount(0),
   userData(userData),
   httpServerThread{} {
   // set up http port
@@ -94,9 +195,11 @@ bool smmServer::beginServer() {
   
   mg_set_protocol_http_websocket(connection);
 
+  polling = true;
   while(running) {
     mg_mgr_poll(&eventManager,1000);
   }
+  polling = false;
   return true;
 }
 
@@ -129,6 +232,45 @@ void smmServer::handleEvent(struct mg_connection* connection,
           mg_http_send_error(connection, 422, "Invalid callback key");
         }
       }
+      // this is a stream request; the reply stays open and parts follow
+      else if (message->uri.len > 8 && strncmp(message->uri.p, "/stream/", 8) == 0) {
+        std::string name(message->uri.p + 8, message->uri.len - 8);
+        server->streamCallbackMutex.lock();
+        std::unordered_map<std::string, struct streamEndpoint>::iterator i = server->streamCallbackMap.find(name);
+        bool found = i != server->streamCallbackMap.end();
+        struct streamEndpoint endpoint;
+        if (found) {
+          endpoint = i->second;
+        }
+        server->streamCallbackMutex.unlock();
+        if (!found) {
+          mg_http_send_error(connection, 404, "Invalid stream key");
+          break;
+        }
+
+        mg_send_response_line(connection, 200, server->httpServerOptions.extra_headers);
+        mg_printf(connection,
+                  "Date: %s\r\n"
+                  "Content-Type: multipart/x-mixed-replace; boundary=%s\r\n"
+                  "Cache-Control: no-cache\r\n"
+                  "Connection: close\r\n"
+                  "\r\n",
+                  getCurrentDateTime().c_str(),
+                  streamBoundary);
+        struct streamConnection stream;
+        stream.name = name;
+        stream.mimeType = endpoint.mimeType;
+        stream.callback = endpoint.callback;
+        stream.id = 0;
+        struct pushConnection* push = new pushConnection();
+        push->streams.push_back(stream);
+        connection->user_data = push;
+        connection->flags |= streamFlag;
+        server->streamCount++;
+
+        // the newest part goes out at once, rather than on the next notification
+        sendStreamPart(connection, server->userData);
+      }
       // this is a GET callback request
       else if ( strstr(message->uri.p, "/get/") == message->uri.p ) {
         char callbackKey[256];
@@ -149,9 +291,46 @@ void smmServer::handleEvent(struct mg_connection* connection,
       }
       break;
     }
+  case MG_EV_WEBSOCKET_HANDSHAKE_REQUEST:
+    {
+      // only /ws speaks WebSocket
+      struct http_message* message = (struct http_message*) eventData;
+      if (mg_vcmp(&message->uri, "/ws") != 0) {
+        mg_http_send_error(connection, 404, "Invalid WebSocket endpoint");
+      }
+      break;
+    }
+  case MG_EV_WEBSOCKET_HANDSHAKE_DONE:
+    {
+      connection->user_data = new pushConnection();
+      connection->flags |= socketFlag;
+      server->streamCount++;
+      break;
+    }
+  case MG_EV_WEBSOCKET_FRAME:
+    {
+      struct websocket_message* message = (struct websocket_message*) eventData;
+      if (connection->flags & socketFlag) {
+        server->handleSocketMessage(connection, std::string((char*) message->data, message->size));
+      }
+      break;
+    }
   case MG_EV_SEND:
     {
-      // do nothing
+      // streams send queued parts as the socket drains
+      if (connection->flags & (streamFlag | socketFlag)) {
+        feedConnection(connection);
+      }
+      break;
+    }
+  case MG_EV_CLOSE:
+    {
+      if (connection->flags & (streamFlag | socketFlag)) {
+        delete (struct pushConnection*) connection->user_data;
+        connection->user_data = NULL;
+        connection->flags &= ~(streamFlag | socketFlag);
+        server->streamCount--;
+      }
       break;
     }
   default:
@@ -227,6 +406,146 @@ void smmServer::removeGetCallback(std::string name) {
   getCallbackMap.erase(name);
   getCallbackMutex.unlock();
 }
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void smmServer::addStreamCallback(std::string name, std::string mimeType, streamCallback_t callback) {
+  struct streamEndpoint endpoint;
+  endpoint.mimeType = mimeType;
+  endpoint.callback = callback;
+  streamCallbackMutex.lock();
+  streamCallbackMap[name] = endpoint;
+  streamCallbackMutex.unlock();
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void smmServer::notifyStreams() {
+  // without listeners there is no need to wake the server thread
+  // (mongoose drops broadcasts without a message, so one byte goes along)
+  if (polling && streamCount > 0) {
+    char message = 0;
+    mg_broadcast(&eventManager, pushStreams, &message, sizeof(message));
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void smmServer::pushStreams(struct mg_connection* connection, int event, void* eventData) {
+  // called on the server thread for every connection, after notifyStreams()
+  smmServer* server = (smmServer*) connection->mgr->user_data;
+  if (connection->flags & streamFlag) {
+    sendStreamPart(connection, server->userData);
+  }
+  else if (connection->flags & socketFlag) {
+    sendSocketParts(connection, server->userData, false);
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void smmServer::sendStreamPart(struct mg_connection* connection, void* userData) {
+  // a client still taking the previous part skips this one; the first part goes out
+  // behind the reply headers
+  struct pushConnection* push = (struct pushConnection*) connection->user_data;
+  struct streamConnection& stream = push->streams[0];
+  if (stream.id != 0 && isBacklogged(connection)) {
+    return;
+  }
+  std::shared_ptr<const std::string> part = stream.callback(stream.id, userData);
+  if (!part) {
+    return;
+  }
+  char head[256];
+  snprintf(head, sizeof(head),
+           "--%s\r\n"
+           "Content-Type: %s\r\n"
+           "Content-Length: %lu\r\n"
+           "\r\n",
+           streamBoundary,
+           stream.mimeType.c_str(),
+           (unsigned long) part->size());
+  static const std::shared_ptr<const std::string> tail = std::make_shared<const std::string>("\r\n");
+  queueBytes(connection, std::make_shared<const std::string>(head));
+  queueBytes(connection, part);
+  queueBytes(connection, tail);
+  feedConnection(connection);
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void smmServer::handleSocketMessage(struct mg_connection* connection, std::string text) {
+  // clients send "subscribe <stream>" or "unsubscribe <stream>"
+  struct pushConnection* push = (struct pushConnection*) connection->user_data;
+  size_t space = text.find(' ');
+  std::string command = text.substr(0, space);
+  std::string name = space == std::string::npos ? "" : text.substr(space + 1);
+
+  size_t index = 0;
+  while (index < push->streams.size() && push->streams[index].name != name) {
+    index++;
+  }
+
+  if (command == "subscribe") {
+    streamCallbackMutex.lock();
+    std::unordered_map<std::string, struct streamEndpoint>::iterator i = streamCallbackMap.find(name);
+    bool found = i != streamCallbackMap.end();
+    struct streamConnection stream;
+    if (found) {
+      stream.name = name;
+      stream.mimeType = i->second.mimeType;
+      stream.callback = i->second.callback;
+      stream.id = 0;
+    }
+    streamCallbackMutex.unlock();
+    if (!found) {
+      queueSocketMessage(connection, WEBSOCKET_OP_TEXT, "error",
+                         std::make_shared<const std::string>("Invalid stream key " + name));
+      feedConnection(connection);
+      return;
+    }
+    if (index == push->streams.size()) {
+      push->streams.push_back(stream);
+    }
+    // the newest part goes out at once, rather than on the next notification
+    sendSocketParts(connection, userData, true);
+  }
+  else if (command == "unsubscribe") {
+    if (index < push->streams.size()) {
+      push->streams.erase(push->streams.begin() + index);
+    }
+  }
+  else {
+    queueSocketMessage(connection, WEBSOCKET_OP_TEXT, "error",
+                       std::make_shared<const std::string>("Invalid command"));
+    feedConnection(connection);
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void smmServer::sendSocketParts(struct mg_connection* connection, void* userData, bool fresh) {
+  // a client still taking earlier messages skips these, as for multipart streams; only
+  // streams that haven't sent anything yet go out regardless, when fresh is set
+  struct pushConnection* push = (struct pushConnection*) connection->user_data;
+  bool backlog = isBacklogged(connection);
+  if (backlog && !fresh) {
+    return;
+  }
+  for (size_t i = 0; i < push->streams.size(); i++) {
+    struct streamConnection& stream = push->streams[i];
+    if (backlog && stream.id != 0) {
+      continue;
+    }
+    std::shared_ptr<const std::string> part = stream.callback(stream.id, userData);
+    if (!part) {
+      continue;
+    }
+    queueSocketMessage(connection, isTextType(stream.mimeType) ? WEBSOCKET_OP_TEXT : WEBSOCKET_OP_BINARY,
+                       stream.name, part);
+  }
+  feedConnection(connection);
+}
   
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
@@ -251,6 +570,16 @@ std::string httpMessage::getHttpVariable(std::string variableName) {
 
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
+std::string httpMessage::getQueryVariable(std::string variableName) {
+  char decodedValue[256];
+  if (mg_get_http_var(&message->query_string, variableName.c_str(), decodedValue, sizeof(decodedValue)) <= 0) {
+    return "";
+  }
+  return std::string(decodedValue);
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
 void httpMessage::replyHttpOk() {
   mg_send_response_line(connection, 200, httpOptions.extra_headers);
   mg_printf(connection,
@@ -274,19 +603,20 @@ void httpMessage::replyHttpError(int code, std::string reason) {
 
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
-void httpMessage::replyHttpContent(std::string mimeType, std::string content) {
+void httpMessage::replyHttpContent(std::string mimeType, const std::string& content) {
+  // the body is sent as bytes, so binary content such as a JPEG survives NULs
   mg_send_response_line(connection, 200, httpOptions.extra_headers);
   mg_printf(connection,
             "Date: %s\r\n"
             "Content-Type: %s\r\n"
-            "Content-Length: %d\r\n"
+            "Content-Length: %lu\r\n"
             "Connection: close\r\n"
-            "\r\n%s",
+            "\r\n",
             getCurrentDateTime().c_str(),
             mimeType.c_str(),
-            strlen(content.c_str()),
-            content.c_str());
+            (unsigned long) content.size());
+  mg_send(connection, content.data(), (int) content.size());
 }
-            
+
 
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
@@ -8,7 +8,9 @@
 
 #include <unordered_map>
 #include <iostream>
+#include <string>
 #include <vector>
+#include <memory>
 #include <thread>
 #include <atomic>
 #include <mutex>
@@ -21,6 +23,17 @@ class httpMessage;
 //typedef void (*callback_t)(struct mg_connection*, struct http_message*, void*);
 typedef void (*callback_t)(httpMessage, void*);
 
+/*! @brief Helper typedef for stream callbacks.
+ *
+ * A stream callback is asked for the next part of a stream, given the id of the last
+ * part the connection was sent. It returns the part's bytes and updates the id, or
+ * returns an empty pointer if there is nothing newer. It runs on the server thread,
+ * once per streaming connection each time smmServer::notifyStreams() is called.
+ * Connections send straight from the returned string, so callbacks should hand every
+ * connection the same one for a part rather than a copy each.
+ */
+typedef std::shared_ptr<const std::string> (*streamCallback_t)(unsigned long& id, void*);
+
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
 /*! @brief Helper class that wraps underlying Mongoose server structures.
@@ -70,6 +83,15 @@ public:
    */
   std::string getHttpVariable(std::string variableName);
 
+  /*! @brief Get a variable from the query string of the request URI.
+   *
+   * @param variableName String containing the name of the variable to extract.
+   *
+   * @returns A string containing the value of the requested variable if it exists,
+   * or an empty string if it doesn't.
+   */
+  std::string getQueryVariable(std::string variableName);
+
   /*! @brief Respond with a simple <tt>200 OK</tt> message. */
   void replyHttpOk();
 
@@ -83,9 +105,10 @@ public:
   /*! @brief Send some content via HTTP.
    *
    * @param mimeType The MIME type of the content being sent.
-   * @param content A string containing the content to send.
+   * @param content A string containing the content to send. It may hold binary data,
+   * NULs included; all of its bytes are sent.
    */
-  void replyHttpContent(std::string mimeType, std::string content);
+  void replyHttpContent(std::string mimeType, const std::string& content);
 };
 
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
@@ -96,6 +119,10 @@ public:
 class smmServer {
 private:
   static void handleEvent(struct mg_connection* connection, int event, void* event_data);
+  static void pushStreams(struct mg_connection* connection, int event, void* event_data);
+  static void sendStreamPart(struct mg_connection* connection, void* userData);
+  static void sendSocketParts(struct mg_connection* connection, void* userData, bool fresh);
+  void handleSocketMessage(struct mg_connection* connection, std::string text);
 
   bool beginServer();
   
@@ -110,6 +137,16 @@ private:
 
   std::mutex postCallbackMutex;
   std::mutex  getCallbackMutex;
+
+  struct streamEndpoint {
+    std::string mimeType;
+    streamCallback_t callback;
+  };
+  std::unordered_map<std::string, struct streamEndpoint> streamCallbackMap;
+  std::mutex streamCallbackMutex;
+
+  std::atomic<bool> polling;
+  std::atomic<int> streamCount;
   
 public:
   /*! @brief The port to serve HTTP content over. */
@@ -206,6 +243,35 @@ public:
    * @param name The string key of the callback to remove.
    */
   void removeGetCallback(std::string name);
+
+  /*! @brief Add a stream.
+   *
+   * A GET request to <tt>/stream/[name]</tt> is answered with a
+   * <tt>multipart/x-mixed-replace</tt> reply that stays open, and each part the
+   * callback returns is pushed to it as it comes. A connection that hasn't taken the
+   * previous part yet skips parts until it has, so slow clients see fewer of them
+   * rather than older ones.
+   *
+   * The WebSocket endpoint <tt>/ws</tt> carries the same streams. A client sends the
+   * text message <tt>subscribe [name]</tt> or <tt>unsubscribe [name]</tt>, and each part
+   * of the streams it subscribed to is sent as one message: the stream's name, a
+   * newline, then the part. Parts of @c text/ and @c application/json streams are text
+   * messages, all others binary. An unknown stream or command is answered with a text
+   * message starting with <tt>error</tt> and a newline.
+   *
+   * @param name Final URI string of the stream.
+   * @param mimeType The MIME type of every part.
+   * @param callback Function pointer to the callback giving the parts.
+   */
+  void addStreamCallback(std::string name, std::string mimeType, streamCallback_t callback);
+
+  /*! @brief Push new parts to every streaming connection.
+   *
+   * Wakes the server thread, which asks each stream's callback for a newer part. Call
+   * this whenever there may be one, e.g. once per frame. It must not be called from
+   * a callback, since those run on the server thread.
+   */
+  void notifyStreams();
   
 };
 
@@ -0,0 +1,226 @@
+#include <iostream>
+#include <algorithm>
+#include <sstream>
+#include <cstdio>
+#include <cmath>
+
+#include <opencv2/imgproc.hpp>
+
+#include "syntheticScene.hpp"
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void defaultSceneSettings(struct sceneSettings* s) {
+  s->trajectory    = "circle";
+  s->waypoints     = "0.2,0.2;0.8,0.3;0.7,0.8;0.3,0.7";
+  s->speed         = 0.25;
+  s->radius        = 0.08;
+  s->ballHue       = 114;
+  s->ballSat       = 200;
+  s->ballVal       = 200;
+  s->noise         = 0;
+  s->motionBlur    = 0;
+  s->lightingDrift = 0;
+  s->driftPeriod   = 10;
+  s->seed          = 1;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+static std::vector<cv::Point2f> parseWaypoints(std::string text, cv::Size size) {
+  std::vector<cv::Point2f> points;
+  std::stringstream stream(text);
+  std::string point;
+  while (std::getline(stream, point, ';')) {
+    float x, y;
+    if (sscanf(point.c_str(), "%f,%f", &x, &y) == 2) {
+      points.push_back(cv::Point2f(x * size.width, y * size.height));
+    }
+  }
+  return points;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+// triangle wave in [0,1] with period 2
+static double triangle(double u) {
+  double phase = std::fmod(u, 2.0);
+  if (phase < 0) {
+    phase += 2.0;
+  }
+  return 1.0 - std::fabs(1.0 - phase);
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+syntheticScene::syntheticScene(const struct sceneSettings& s, cv::Size size, double frameRate) :
+  settings(s),
+  size(size),
+  frameRate(frameRate > 0 ? frameRate : 30) {
+  radius = std::max(1.0, s.radius * std::min(size.width, size.height));
+
+  cv::Mat hsv(1, 1, CV_8UC3, cv::Scalar(s.ballHue, s.ballSat, s.ballVal));
+  cv::Mat bgr;
+  cv::cvtColor(hsv, bgr, cv::COLOR_HSV2BGR);
+  ballColor = bgr.at<cv::Vec3b>(0, 0);
+
+  if (s.trajectory == "waypoints") {
+    path = parseWaypoints(s.waypoints, size);
+    if (path.size() < 2) {
+      std::cerr << "error: need at least two waypoints; falling back to a circle" << std::endl;
+      settings.trajectory = "circle";
+    }
+  }
+
+  // low-saturation blotches with a fine checker on top, so the background has
+  // texture for the thresholds to reject but never looks like the ball
+  cv::RNG rng(s.seed);
+  cv::Mat blotches(size.height/24 + 2, size.width/24 + 2, CV_8UC3);
+  for (int y = 0; y < blotches.rows; y++) {
+    cv::Vec3b* row = blotches.ptr<cv::Vec3b>(y);
+    for (int x = 0; x < blotches.cols; x++) {
+      int gray = rng.uniform(50, 170);
+      for (int c = 0; c < 3; c++) {
+        row[x][c] = cv::saturate_cast<uchar>(gray + rng.uniform(-12, 12));
+      }
+    }
+  }
+  cv::resize(blotches, background, size, 0, 0, cv::INTER_CUBIC);
+  for (int y = 0; y < size.height; y++) {
+    cv::Vec3b* row = background.ptr<cv::Vec3b>(y);
+    for (int x = 0; x < size.width; x++) {
+      int offset = ((x/8 + y/8) & 1) ? 10 : -10;
+      for (int c = 0; c < 3; c++) {
+        row[x][c] = cv::saturate_cast<uchar>(row[x][c] + offset);
+      }
+    }
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+cv::Point2f syntheticScene::positionAt(double t) {
+  double w = size.width;
+  double h = size.height;
+  double laps = settings.speed * t;
+
+  if (settings.trajectory == "figure8") {
+    return cv::Point2f(w/2 + 0.35*w * std::sin(2*CV_PI * laps),
+                       h/2 + 0.30*h * std::sin(4*CV_PI * laps));
+  }
+  else if (settings.trajectory == "bounce") {
+    // bounce off the walls, with the vertical speed incommensurate with the horizontal
+    double spanX = std::max(1.0, w - 2*radius);
+    double spanY = std::max(1.0, h - 2*radius);
+    double distance = settings.speed * w * t;
+    return cv::Point2f(radius + spanX * triangle(distance / spanX),
+                       radius + spanY * triangle(0.61 * distance / spanY));
+  }
+  else if (settings.trajectory == "waypoints") {
+    double length = 0;
+    for (size_t i = 0; i < path.size(); i++) {
+      cv::Point2f d = path[(i+1) % path.size()] - path[i];
+      length += std::sqrt(d.x*d.x + d.y*d.y);
+    }
+    double remaining = (laps - std::floor(laps)) * length;
+    for (size_t i = 0; i < path.size(); i++) {
+      cv::Point2f a = path[i];
+      cv::Point2f d = path[(i+1) % path.size()] - a;
+      double segment = std::sqrt(d.x*d.x + d.y*d.y);
+      if (remaining <= segment && segment > 0) {
+        float f = remaining / segment;
+        return cv::Point2f(a.x + f*d.x, a.y + f*d.y);
+      }
+      remaining -= segment;
+    }
+    return path[0];
+  }
+
+  // circle
+  return cv::Point2f(w/2 + 0.35*w * std::cos(2*CV_PI * laps),
+                     h/2 + 0.35*h * std::sin(2*CV_PI * laps));
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void syntheticScene::render(unsigned long frameNumber, cv::Mat& image, struct ballTruth* truth) {
+  double t = frameNumber / frameRate;
+  double shutter = settings.motionBlur / frameRate;
+
+  // sample the trajectory across the exposure; roughly one sample per pixel moved
+  int samples = 1;
+  if (shutter > 0) {
+    cv::Point2f d = positionAt(t + shutter) - positionAt(t);
+    samples = std::min(16, std::max(2, (int) std::ceil(std::sqrt(d.x*d.x + d.y*d.y))));
+  }
+
+  std::vector<cv::Point2f> centers(samples);
+  cv::Point2f mean(0, 0);
+  float minX = size.width, minY = size.height, maxX = 0, maxY = 0;
+  for (int i = 0; i < samples; i++) {
+    centers[i] = positionAt(t + shutter * (i + 0.5) / samples);
+    mean += centers[i];
+    minX = std::min(minX, centers[i].x);
+    minY = std::min(minY, centers[i].y);
+    maxX = std::max(maxX, centers[i].x);
+    maxY = std::max(maxY, centers[i].y);
+  }
+  mean *= 1.0f / samples;
+
+  truth->center  = mean;
+  truth->radius  = radius;
+  truth->visible = mean.x >= 0 && mean.y >= 0 && mean.x < size.width && mean.y < size.height;
+
+  background.copyTo(image);
+
+  // accumulate anti-aliased coverage of the ball over the exposure, only in its
+  // bounding box, then blend the ball color in by coverage
+  int margin = (int) std::ceil(radius) + 2;
+  cv::Rect roi((int) std::floor(minX) - margin,
+               (int) std::floor(minY) - margin,
+               (int) std::ceil(maxX - minX) + 2*margin,
+               (int) std::ceil(maxY - minY) + 2*margin);
+  roi &= cv::Rect(0, 0, size.width, size.height);
+
+  if (!roi.empty()) {
+    coverage.create(roi.size(), CV_16U);
+    coverage.setTo(cv::Scalar(0));
+    for (int i = 0; i < samples; i++) {
+      stroke.create(roi.size(), CV_8U);
+      stroke.setTo(cv::Scalar(0));
+      cv::Point center(cvRound((centers[i].x - roi.x) * 16), cvRound((centers[i].y - roi.y) * 16));
+      cv::circle(stroke, center, cvRound(radius * 16), cv::Scalar(255), cv::FILLED, cv::LINE_AA, 4);
+      cv::add(coverage, stroke, coverage, cv::noArray(), CV_16U);
+    }
+
+    cv::Mat target = image(roi);
+    for (int y = 0; y < roi.height; y++) {
+      const unsigned short* cov = coverage.ptr<unsigned short>(y);
+      cv::Vec3b* row = target.ptr<cv::Vec3b>(y);
+      for (int x = 0; x < roi.width; x++) {
+        int a = cov[x] / samples;
+        if (a == 0) {
+          continue;
+        }
+        for (int c = 0; c < 3; c++) {
+          row[x][c] = (uchar) ((row[x][c] * (255 - a) + ballColor[c] * a + 127) / 255);
+        }
+      }
+    }
+  }
+
+  if (settings.lightingDrift != 0 && settings.driftPeriod > 0) {
+    double gain = 1.0 + settings.lightingDrift * std::sin(2*CV_PI * t / settings.driftPeriod);
+    image.convertTo(image, -1, gain);
+  }
+
+  if (settings.noise > 0) {
+    // seed per frame so frame n is the same however the frames are visited
+    cv::RNG rng((uint64) settings.seed * 7919 + frameNumber);
+    noise.create(size, CV_16SC3);
+    rng.fill(noise, cv::RNG::NORMAL, 0, settings.noise);
+    cv::add(image, noise, image, cv::noArray(), CV_8U);
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
@@ -0,0 +1,105 @@
+/*! @file
+ * Defines the syntheticScene class, which renders a colored ball moving along a
+ * scripted trajectory over a textured background. Every rendered frame comes with
+ * the ball's true position, so the vision pipeline can be checked for accuracy as
+ * well as speed without a camera attached.
+ */
+
+#ifndef SMM_SYNTHETIC_SCENE_HPP
+#define SMM_SYNTHETIC_SCENE_HPP
+
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+/*! @brief Settings describing a synthetic scene. */
+struct sceneSettings {
+  /*! @brief One of @c circle, @c figure8, @c bounce or @c waypoints. */
+  std::string trajectory;
+  /*! @brief Waypoints for the @c waypoints trajectory, as <tt>x,y;x,y;...</tt>
+   * in fractions of the frame size. The ball loops through them in order. */
+  std::string waypoints;
+  /*! @brief Trajectory speed: laps per second for @c circle, @c figure8 and
+   * @c waypoints; frame widths per second for @c bounce. */
+  double speed;
+  /*! @brief Ball radius as a fraction of the smaller frame dimension. */
+  double radius;
+  /*! @brief Ball color, in OpenCV's 8-bit HSV ranges (hue 0-179). */
+  int ballHue;
+  int ballSat;
+  int ballVal;
+  /*! @brief Standard deviation of per-pixel Gaussian noise, in gray levels. */
+  double noise;
+  /*! @brief Shutter time as a fraction of the frame interval; 0 disables motion blur. */
+  double motionBlur;
+  /*! @brief Amplitude of the slow global brightness oscillation, as a fraction. */
+  double lightingDrift;
+  /*! @brief Period of the brightness oscillation, in seconds. */
+  double driftPeriod;
+  /*! @brief Seed for the background texture and noise. */
+  int seed;
+};
+
+/*! @brief Fill a sceneSettings struct with the defaults. */
+void defaultSceneSettings(struct sceneSettings* s);
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+/*! @brief The true state of the ball in a rendered frame. */
+struct ballTruth {
+  /*! @brief @c True if the ball's center lies inside the frame. */
+  bool visible;
+  /*! @brief The centroid of the ball over the exposure, in pixels. */
+  cv::Point2f center;
+  /*! @brief The ball radius, in pixels. */
+  float radius;
+};
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+/*! @class syntheticScene
+ * @brief Deterministic renderer for the moving-ball test scene.
+ *
+ * Frame @c n always renders identically for the same settings and size, regardless
+ * of when it is rendered, so benchmark runs are repeatable.
+ */
+class syntheticScene {
+private:
+  cv::Point2f positionAt(double t);
+
+  struct sceneSettings settings;
+  cv::Size size;
+  double frameRate;
+  float radius;
+  cv::Vec3b ballColor;
+  std::vector<cv::Point2f> path;
+
+  cv::Mat background;
+  cv::Mat noise;
+  cv::Mat coverage;
+  cv::Mat stroke;
+
+public:
+  /*! @brief syntheticScene constructor.
+   *
+   * @param s The scene settings.
+   * @param size The frame size to render.
+   * @param frameRate The frame rate used to convert frame numbers to scene time.
+   */
+  syntheticScene(const struct sceneSettings& s, cv::Size size, double frameRate);
+
+  /*! @brief Render a frame.
+   *
+   * @param frameNumber Which frame to render.
+   * @param image The Mat to render into. Its buffer is reused when the size matches.
+   * @param truth Receives the true ball state for the frame.
+   */
+  void render(unsigned long frameNumber, cv::Mat& image, struct ballTruth* truth);
+};
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#endif
@@ -0,0 +1,108 @@
+#include "threadPool.hpp"
+#include "allocationCounter.hpp"
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+threadPool::threadPool(int threads) :
+  workers(),
+  runMutex(),
+  queueMutex(),
+  workSignal(),
+  doneSignal(),
+  task(NULL),
+  taskData(NULL),
+  nextTask(0),
+  taskCount(0),
+  unfinished(0),
+  generation(0),
+  stopping(false),
+  workerAllocations(0) {
+  // the caller of run() is the last thread
+  for (int i = 1; i < threads; i++) {
+    workers.push_back(std::thread{&threadPool::workerLoop, this});
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+threadPool::~threadPool() {
+  queueMutex.lock();
+  stopping = true;
+  queueMutex.unlock();
+  workSignal.notify_all();
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+int threadPool::size() {
+  return (int) workers.size() + 1;
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void threadPool::runTasks(std::unique_lock<std::mutex>& lock, bool worker) {
+  // called with the queue locked; the lock is dropped while a task runs
+  while (nextTask < taskCount) {
+    int i = nextTask++;
+    void (*f)(int, void*) = task;
+    void* data = taskData;
+    lock.unlock();
+    unsigned long before = threadAllocations();
+    f(i, data);
+    unsigned long allocations = threadAllocations() - before;
+    lock.lock();
+    if (worker) {
+      workerAllocations += allocations;
+    }
+    if (--unfinished == 0) {
+      doneSignal.notify_all();
+    }
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void threadPool::workerLoop() {
+  unsigned long seen = 0;
+  std::unique_lock<std::mutex> lock(queueMutex);
+  while (true) {
+    workSignal.wait(lock, [this, seen] { return stopping || generation != seen; });
+    if (stopping) {
+      return;
+    }
+    seen = generation;
+    runTasks(lock, true);
+  }
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+void threadPool::run(int count, void (*f)(int, void*), void* data) {
+  if (count <= 0) {
+    return;
+  }
+
+  runMutex.lock();
+  std::unique_lock<std::mutex> lock(queueMutex);
+  task = f;
+  taskData = data;
+  nextTask = 0;
+  taskCount = count;
+  unfinished = count;
+  generation++;
+  workSignal.notify_all();
+
+  runTasks(lock, false);
+  doneSignal.wait(lock, [this] { return unfinished == 0; });
+  task = NULL;
+  taskData = NULL;
+  chargeAllocations(workerAllocations);
+  workerAllocations = 0;
+  lock.unlock();
+  runMutex.unlock();
+}
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
@@ -0,0 +1,84 @@
+/*! @file
+ * Defines the threadPool class, a fixed set of worker threads that run the tasks of
+ * one parallel loop at a time.
+ */
+
+#ifndef SMM_THREAD_POOL_HPP
+#define SMM_THREAD_POOL_HPP
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+/*! @class threadPool
+ * @brief Runs numbered tasks on a fixed set of threads.
+ *
+ * run() hands out task numbers to the workers and to the calling thread, and returns
+ * once every task has finished. The threads are started once and sleep between loops,
+ * so a loop costs a wake-up rather than a thread launch, and nothing is allocated.
+ */
+class threadPool {
+private:
+  void workerLoop();
+  void runTasks(std::unique_lock<std::mutex>& lock, bool worker);
+
+  std::vector<std::thread> workers;
+
+  std::mutex runMutex;
+  std::mutex queueMutex;
+  std::condition_variable workSignal;
+  std::condition_variable doneSignal;
+  void (*task)(int, void*);
+  void* taskData;
+  int nextTask;
+  int taskCount;
+  int unfinished;
+  unsigned long generation;
+  bool stopping;
+  unsigned long workerAllocations;
+
+public:
+  /*! @brief threadPool constructor.
+   *
+   * @param threads Total number of threads to run tasks on, including the caller of
+   * run(); a pool of 1 runs everything on the calling thread.
+   */
+  threadPool(int threads);
+
+  /*! @brief threadPool destructor. Stops and joins the workers. */
+  ~threadPool();
+
+  /*! @brief Returns the number of threads tasks run on, including the caller. */
+  int size();
+
+  /*! @brief Run tasks @c 0 to <tt>count-1</tt> and wait for all of them.
+   *
+   * Only one loop runs at a time; concurrent callers take turns. Heap allocations the
+   * workers make while running the tasks are counted against the caller; see
+   * allocationCounter.hpp.
+   *
+   * @param count Number of tasks.
+   * @param task Called once with each task number and @c data, from any of the pool's threads.
+   * @param data Pointer passed to @c task.
+   */
+  void run(int count, void (*task)(int, void*), void* data);
+
+  /*! @brief Run tasks @c 0 to <tt>count-1</tt> and wait for all of them.
+   *
+   * @param count Number of tasks.
+   * @param task A function object, e.g. a lambda, called once with each task number.
+   * It is called in place rather than copied into a std::function, so it may capture
+   * as much as it likes without allocating.
+   */
+  template<typename F>
+  void run(int count, const F& task) {
+    run(count, [](int i, void* f) { (*(const F*) f)(i); }, (void*) &task);
+  }
+};
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#endif
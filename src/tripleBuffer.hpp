@@ -0,0 +1,83 @@
+/*! @file
+ * Defines a lock-free triple buffer for handing the newest value from one
+ * producer thread to a consumer without either side ever waiting.
+ */
+
+#ifndef SMM_TRIPLE_BUFFER_HPP
+#define SMM_TRIPLE_BUFFER_HPP
+
+#include <atomic>
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+/*! @brief Single-producer, single-consumer triple buffer.
+ *
+ * The producer always owns one slot (the back buffer) and the consumer always owns
+ * another (the front buffer). The third slot sits in the middle and is swapped
+ * atomically: the producer swaps its freshly written back buffer into the middle, and
+ * the consumer swaps its front buffer out for the middle one when something new has
+ * been published. Neither swap can block, so the producer runs at full rate and the
+ * consumer always sees the newest complete value.
+ *
+ * Only one thread may write and only one thread may read at a time; guard the reader
+ * side with a mutex if several threads need to consume.
+ */
+template<typename T>
+class tripleBuffer {
+private:
+  static const int indexMask = 0x3;
+  static const int freshBit  = 0x4;
+
+  T buffers[3];
+  int back;
+  int front;
+  std::atomic<int> middle;
+
+public:
+  /*! @brief Construct an empty triple buffer. */
+  tripleBuffer() : back(0), front(1), middle(2) {}
+
+  tripleBuffer(const tripleBuffer&) = delete;
+  tripleBuffer& operator=(const tripleBuffer&) = delete;
+
+  /*! @brief Get the slot the producer is allowed to write into.
+   *
+   * The slot is owned by the producer until publish() is called.
+   */
+  T& writeBuffer() {
+    return buffers[back];
+  }
+
+  /*! @brief Make the current write buffer visible to the consumer.
+   *
+   * If the consumer has not picked up the previously published value, that value is
+   * recycled as the next write buffer.
+   */
+  void publish() {
+    back = middle.exchange(back | freshBit, std::memory_order_acq_rel) & indexMask;
+  }
+
+  /*! @brief Swap in the newest published value, if there is one.
+   *
+   * @returns @c True if the read buffer changed; @c False otherwise.
+   */
+  bool update() {
+    if ((middle.load(std::memory_order_acquire) & freshBit) == 0) {
+      return false;
+    }
+    front = middle.exchange(front, std::memory_order_acq_rel) & indexMask;
+    return true;
+  }
+
+  /*! @brief Get the slot the consumer is allowed to read from.
+   *
+   * The contents stay valid until the next call to update().
+   */
+  T& readBuffer() {
+    return buffers[front];
+  }
+};
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#endif